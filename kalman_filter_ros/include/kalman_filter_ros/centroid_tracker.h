@@ -0,0 +1,83 @@
+/**
+ * @file centroid_tracker.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief The stamped filter of KalmanTracker without the ROS transport: counts the
+ * initializing detections and keeps the stamp the state refers to. Shared by
+ * KalmanTracker and the offline pipeline.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef KALMAN_FILTER_ROS_CENTROID_TRACKER_H
+#define KALMAN_FILTER_ROS_CENTROID_TRACKER_H
+
+#include <kalman_filter_ros/constant_velocity_kalman.h>
+#include <ros/console.h>
+#include <ros/time.h>
+
+#include <algorithm>
+
+namespace kalman_filter_ros {
+
+class CentroidTracker {
+public:
+    /**
+     * @param init_detections Detections that only pull the state away from the origin
+     * before it is worth publishing
+     */
+    CentroidTracker(float process_noise = 0.01f, float measurement_noise = 0.1f, float nominal_dt = 1.0f / 30.0f,
+                    int init_detections = 5)
+        : filter_(process_noise, measurement_noise, nominal_dt), detections_(0), init_detections_(init_detections) {}
+
+    /**
+     * @brief Fuses a centroid measured at stamp, predicting over the real time since the
+     * last state first
+     *
+     * @return false while the filter is still initializing, nothing should be published
+     */
+    bool update(const ros::Time& stamp, const ConstantVelocityKalman::Measurement& z) {
+        if (detections_ < init_detections_) {
+            ROS_INFO_ONCE("I m intializing");
+            filter_.update(z);
+            filter_time_ = stamp;
+            ++detections_;
+            return false;
+        }
+        filter_.predict((stamp - filter_time_).toSec());
+        filter_.update(z);
+        filter_time_ = std::max(filter_time_, stamp);
+        return true;
+    }
+
+    /**
+     * @brief Predicts the state up to now without a measurement
+     *
+     * @return false while the filter is still initializing
+     */
+    bool predictTo(const ros::Time& now) {
+        if (!initialized()) {
+            return false;
+        }
+        filter_.predict((now - filter_time_).toSec());
+        filter_time_ = std::max(filter_time_, now);
+        return true;
+    }
+
+    bool initialized() const { return detections_ >= init_detections_; }
+
+    ConstantVelocityKalman::Measurement position() const { return filter_.position(); }
+
+private:
+    ConstantVelocityKalman filter_;
+    // Stamp the filter state refers to
+    ros::Time filter_time_;
+    int detections_;
+    int init_detections_;
+};
+
+}  // namespace kalman_filter_ros
+
+#endif  // KALMAN_FILTER_ROS_CENTROID_TRACKER_H
@@ -0,0 +1,99 @@
+/**
+ * @file constant_velocity_kalman.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Constant velocity Kalman filter on fixed size float matrices, the model of
+ * kalman_filter_node.py with the time step taken from the message stamps
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef KALMAN_FILTER_ROS_CONSTANT_VELOCITY_KALMAN_H
+#define KALMAN_FILTER_ROS_CONSTANT_VELOCITY_KALMAN_H
+
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+namespace kalman_filter_ros {
+
+/**
+ * @brief State [x, vx, y, vy, z, vz], measurement [x, y, z]. All matrices are fixed
+ * size so neither predict nor update allocates.
+ *
+ */
+class ConstantVelocityKalman {
+public:
+    using State = Eigen::Matrix<float, 6, 1>;
+    using StateMatrix = Eigen::Matrix<float, 6, 6>;
+    using Measurement = Eigen::Vector3f;
+
+    /**
+     * @brief Starts at the origin with unit covariance, like filterpy. The defaults are
+     * the Q, R and rate of kalman_filter_node.py.
+     *
+     * @param process_noise Diagonal of Q for a step of nominal_dt
+     * @param measurement_noise Diagonal of R
+     * @param nominal_dt Step the process noise was tuned for, Q is scaled by dt / nominal_dt
+     */
+    explicit ConstantVelocityKalman(float process_noise = 0.01f, float measurement_noise = 0.1f,
+                                    float nominal_dt = 1.0f / 30.0f)
+        : process_noise_(process_noise), nominal_dt_(nominal_dt) {
+        x_.setZero();
+        P_.setIdentity();
+        R_ = Eigen::Matrix3f::Identity() * measurement_noise;
+    }
+
+    /**
+     * @brief Propagates the state by dt seconds, a non positive dt is ignored
+     *
+     */
+    void predict(float dt) {
+        if (!(dt > 0.0f)) {
+            return;
+        }
+        StateMatrix F = StateMatrix::Identity();
+        F(0, 1) = dt;
+        F(2, 3) = dt;
+        F(4, 5) = dt;
+        x_ = F * x_;
+        P_ = F * P_ * F.transpose();
+        P_.diagonal().array() += process_noise_ * (dt / nominal_dt_);
+    }
+
+    /**
+     * @brief Fuses one position measurement
+     *
+     */
+    void update(const Measurement& z) {
+        // H selects x, y and z, so H x, H P and P H^T are row and column picks
+        const Measurement y = z - Measurement(x_(0), x_(2), x_(4));
+        Eigen::Matrix<float, 6, 3> PHt;
+        PHt << P_.col(0), P_.col(2), P_.col(4);
+        Eigen::Matrix3f S;
+        S << PHt.row(0), PHt.row(2), PHt.row(4);
+        S += R_;
+        const Eigen::Matrix<float, 6, 3> K = PHt * S.inverse();
+        x_ += K * y;
+        P_ -= K * PHt.transpose();
+        // Keep P symmetric against float round off
+        P_ = 0.5f * (P_ + P_.transpose()).eval();
+    }
+
+    Measurement position() const { return Measurement(x_(0), x_(2), x_(4)); }
+    Measurement velocity() const { return Measurement(x_(1), x_(3), x_(5)); }
+    const State& state() const { return x_; }
+    const StateMatrix& covariance() const { return P_; }
+
+private:
+    State x_;
+    StateMatrix P_;
+    Eigen::Matrix3f R_;
+    float process_noise_;
+    float nominal_dt_;
+};
+
+}  // namespace kalman_filter_ros
+
+#endif  // KALMAN_FILTER_ROS_CONSTANT_VELOCITY_KALMAN_H
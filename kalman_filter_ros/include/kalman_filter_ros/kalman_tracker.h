@@ -0,0 +1,70 @@
+/**
+ * @file kalman_tracker.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief KalmanTracker filters the centroids on /detections and publishes the tracked
+ * position on /predicted_positions. Updates run in the /detections callback, a timer
+ * only predicts while the detections drop out. Used by the standalone node and by the
+ * nodelet.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef KALMAN_FILTER_ROS_KALMAN_TRACKER_H
+#define KALMAN_FILTER_ROS_KALMAN_TRACKER_H
+
+#include <kalman_filter_ros/centroid_tracker.h>
+#include <geometry_msgs/PointStamped.h>
+#include <ros/ros.h>
+#include <std_msgs/Bool.h>
+#include <pipeline_diagnostics/stage_diagnostics.h>
+
+#include <memory>
+#include <mutex>
+
+namespace kalman_filter_ros {
+
+class KalmanTracker {
+public:
+    /**
+     * @brief Subscribes and advertises on nh, parameters are read from pnh
+     *
+     */
+    KalmanTracker(ros::NodeHandle nh, ros::NodeHandle pnh);
+
+    void detectionsCallback(const geometry_msgs::PointStampedConstPtr& msg);
+
+    void objectAvailableCallback(const std_msgs::BoolConstPtr& msg);
+
+    void dropoutCallback(const ros::TimerEvent& event);
+
+private:
+    // Stages timed on /diagnostics
+    enum Stage : size_t {
+        kStageUpdate,
+        kStagePredict,
+        kStagePublish,
+        kStageAgeIn,
+        kStageAgeOut,
+    };
+
+    void publish(const ros::Time& stamp);
+
+    ros::Subscriber sub_detections_;
+    ros::Subscriber sub_object_available_;
+    ros::Publisher pub_predicted_positions_;
+    // Fires only when no detection arrived for one prediction period, restarted by every update
+    ros::Timer dropout_timer_;
+    // The timer and the subscriptions may run on different threads of a nodelet manager
+    std::mutex mutex_;
+    CentroidTracker tracker_;
+    bool object_available_;
+    geometry_msgs::PointStamped predicted_msg_;
+    std::unique_ptr<pipeline_diagnostics::StageDiagnostics> diagnostics_;
+};
+
+}  // namespace kalman_filter_ros
+
+#endif  // KALMAN_FILTER_ROS_KALMAN_TRACKER_H
@@ -0,0 +1,95 @@
+/**
+ * @file kalman_tracker.cpp
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Implementation of the event driven constant velocity tracker
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <kalman_filter_ros/kalman_tracker.h>
+
+#include <algorithm>
+
+namespace kalman_filter_ros {
+
+KalmanTracker::KalmanTracker(ros::NodeHandle nh, ros::NodeHandle pnh)
+    : object_available_(false) {
+    double process_noise, measurement_noise, prediction_rate;
+    int init_detections;
+    pnh.param("process_noise", process_noise, 0.01);
+    pnh.param("measurement_noise", measurement_noise, 0.1);
+    pnh.param("prediction_rate", prediction_rate, 30.0);
+    // The first detections only pull the state away from the origin, nothing is published
+    pnh.param("init_detections", init_detections, 5);
+    prediction_rate = std::max(prediction_rate, 1.0);
+    tracker_ = CentroidTracker(process_noise, measurement_noise, 1.0 / prediction_rate, init_detections);
+    diagnostics_.reset(new pipeline_diagnostics::StageDiagnostics(
+        nh, pnh, "kalman_tracker", {"update", "predict", "publish", "age_in", "age_out"}));
+    pub_predicted_positions_ = nh.advertise<geometry_msgs::PointStamped>("/predicted_positions", 10);
+    dropout_timer_ = nh.createTimer(ros::Duration(1.0 / prediction_rate), &KalmanTracker::dropoutCallback, this,
+                                    false, false);
+    sub_object_available_ = nh.subscribe("/object_available", 10, &KalmanTracker::objectAvailableCallback, this);
+    sub_detections_ = nh.subscribe("/detections", 10, &KalmanTracker::detectionsCallback, this);
+}
+
+void KalmanTracker::objectAvailableCallback(const std_msgs::BoolConstPtr& msg) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    object_available_ = msg->data;
+}
+
+void KalmanTracker::detectionsCallback(const geometry_msgs::PointStampedConstPtr& msg) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const ros::Time now = ros::Time::now();
+    diagnostics_->recordAge(kStageAgeIn, msg->header.stamp, now);
+    const ros::Time stamp = msg->header.stamp.isZero() ? now : msg->header.stamp;
+    const ConstantVelocityKalman::Measurement z(msg->point.x, msg->point.y, msg->point.z);
+    // Predict over the real time since the last state, then fuse the measurement
+    bool initialized;
+    {
+        pipeline_diagnostics::ScopedStageTimer timer((*diagnostics_)[kStageUpdate]);
+        initialized = tracker_.update(stamp, z);
+    }
+    if (!initialized) {
+        return;
+    }
+    if (object_available_) {
+        publish(stamp);
+    }
+    // Push the next dropout prediction one period past this update
+    dropout_timer_.stop();
+    dropout_timer_.start();
+}
+
+void KalmanTracker::dropoutCallback(const ros::TimerEvent&) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!tracker_.initialized() || !object_available_) {
+        ROS_DEBUG_THROTTLE(1.0, "No drone present!!");
+        return;
+    }
+    const ros::Time now = ros::Time::now();
+    {
+        pipeline_diagnostics::ScopedStageTimer timer((*diagnostics_)[kStagePredict]);
+        tracker_.predictTo(now);
+    }
+    publish(now);
+}
+
+void KalmanTracker::publish(const ros::Time& stamp) {
+    const ConstantVelocityKalman::Measurement position = tracker_.position();
+    predicted_msg_.header.stamp = stamp;
+    predicted_msg_.point.x = position(0);
+    predicted_msg_.point.y = position(1);
+    predicted_msg_.point.z = position(2);
+    {
+        pipeline_diagnostics::ScopedStageTimer timer((*diagnostics_)[kStagePublish]);
+        pub_predicted_positions_.publish(predicted_msg_);
+    }
+    // Time from the stamp of the fused detection, or of the dropout tick, to the output
+    diagnostics_->recordAge(kStageAgeOut, stamp, ros::Time::now());
+    ROS_DEBUG("Prediction: x=%.1f, y=%.1f, z=%.1f", position(0), position(1), position(2));
+}
+
+}  // namespace kalman_filter_ros
@@ -0,0 +1,23 @@
+/**
+ * @file kalman_tracker_node.cpp
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief CPP Node that tracks the centroid on /detections and publishes the filtered
+ * position on /predicted_positions
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <ros/ros.h>
+#include <kalman_filter_ros/kalman_tracker.h>
+
+int main(int argc, char** argv) {
+    ros::init(argc, argv, "kalman_tracker_node");
+    ros::NodeHandle nh;
+    ros::NodeHandle pnh("~");
+    kalman_filter_ros::KalmanTracker tracker(nh, pnh);
+    ros::spin();
+    return 0;
+}
@@ -0,0 +1,32 @@
+/**
+ * @file kalman_tracker_nodelet.cpp
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Nodelet wrapper around KalmanTracker. Loaded in the same manager as the
+ * detection nodelet it receives /detections without serialization
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <kalman_filter_ros/kalman_tracker.h>
+
+#include <memory>
+
+namespace kalman_filter_ros {
+
+class KalmanTrackerNodelet : public nodelet::Nodelet {
+private:
+    void onInit() override {
+        tracker_.reset(new KalmanTracker(getNodeHandle(), getPrivateNodeHandle()));
+    }
+
+    std::unique_ptr<KalmanTracker> tracker_;
+};
+
+}  // namespace kalman_filter_ros
+
+PLUGINLIB_EXPORT_CLASS(kalman_filter_ros::KalmanTrackerNodelet, nodelet::Nodelet)
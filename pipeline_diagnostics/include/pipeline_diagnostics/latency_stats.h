@@ -0,0 +1,202 @@
+/**
+ * @file latency_stats.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Lock-free latency histograms and scoped stage timers for the hot paths of the
+ * C++ nodes. Recording is a handful of relaxed atomic adds, reading drains the counts
+ * gathered since the previous read.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef PIPELINE_DIAGNOSTICS_LATENCY_STATS_H
+#define PIPELINE_DIAGNOSTICS_LATENCY_STATS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pipeline_diagnostics {
+
+/**
+ * @brief Fixed bucket histogram of durations in nanoseconds. Every power of two is split
+ * into four buckets, so a reported percentile is within 25 % of the true value, from
+ * 1 ns up to 2^33 ns, about 8.6 s. Longer durations count in the top bucket.
+ *
+ */
+class LatencyHistogram {
+public:
+    static constexpr int kBuckets = 128;
+
+    /**
+     * @brief Statistics of the durations recorded since the previous drain, in microseconds
+     *
+     */
+    struct Summary {
+        uint64_t count = 0;
+        double mean_us = 0.0;
+        double p50_us = 0.0;
+        double p99_us = 0.0;
+        double max_us = 0.0;
+    };
+
+    LatencyHistogram() {
+        for (auto& bucket : buckets_) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Safe to call from any number of threads, negative durations count as 0
+     *
+     */
+    void record(int64_t ns) {
+        const uint64_t value = ns > 0 ? static_cast<uint64_t>(ns) : 0;
+        buckets_[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        sum_ns_.fetch_add(value, std::memory_order_relaxed);
+        uint64_t max = max_ns_.load(std::memory_order_relaxed);
+        while (value > max && !max_ns_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     * @brief Summarises and clears the histogram. Meant for one reader, a record racing
+     * with the drain lands in either window.
+     *
+     */
+    Summary drain() {
+        std::array<uint32_t, kBuckets> counts;
+        Summary summary;
+        for (int i = 0; i < kBuckets; ++i) {
+            counts[i] = buckets_[i].exchange(0, std::memory_order_relaxed);
+            summary.count += counts[i];
+        }
+        const uint64_t sum_ns = sum_ns_.exchange(0, std::memory_order_relaxed);
+        const uint64_t max_ns = max_ns_.exchange(0, std::memory_order_relaxed);
+        if (summary.count == 0) {
+            return summary;
+        }
+        summary.mean_us = 1e-3 * static_cast<double>(sum_ns) / static_cast<double>(summary.count);
+        summary.max_us = 1e-3 * static_cast<double>(max_ns);
+        // A bucket bound can overshoot the largest sample, which is known exactly
+        summary.p50_us = std::min(summary.max_us, 1e-3 * percentile(counts, summary.count, 0.50));
+        summary.p99_us = std::min(summary.max_us, 1e-3 * percentile(counts, summary.count, 0.99));
+        return summary;
+    }
+
+private:
+    static int bucketOf(uint64_t ns) {
+        if (ns < 4) {
+            return static_cast<int>(ns);
+        }
+        const int msb = 63 - __builtin_clzll(ns);
+        const int sub = static_cast<int>((ns >> (msb - 2)) & 3u);
+        const int bucket = (msb - 1) * 4 + sub;
+        return bucket < kBuckets ? bucket : kBuckets - 1;
+    }
+
+    static double bucketUpperNs(int bucket) {
+        if (bucket < 4) {
+            return bucket + 1;
+        }
+        const int msb = bucket / 4 + 1;
+        const int sub = bucket % 4;
+        return static_cast<double>(static_cast<uint64_t>(5 + sub) << (msb - 2));
+    }
+
+    static double percentile(const std::array<uint32_t, kBuckets>& counts, uint64_t total, double q) {
+        const double rank = q * static_cast<double>(total);
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; ++i) {
+            seen += counts[i];
+            if (static_cast<double>(seen) >= rank && counts[i] > 0) {
+                return bucketUpperNs(i);
+            }
+        }
+        return bucketUpperNs(kBuckets - 1);
+    }
+
+    std::array<std::atomic<uint32_t>, kBuckets> buckets_;
+    std::atomic<uint64_t> sum_ns_{0};
+    std::atomic<uint64_t> max_ns_{0};
+};
+
+/**
+ * @brief Named histograms of one node, created once in the constructor
+ *
+ */
+class StageStats {
+public:
+    explicit StageStats(std::vector<std::string> names)
+        : names_(std::move(names)), histograms_(new LatencyHistogram[names_.size()]) {}
+
+    LatencyHistogram& operator[](size_t stage) { return histograms_[stage]; }
+    const std::string& name(size_t stage) const { return names_[stage]; }
+    size_t size() const { return names_.size(); }
+
+private:
+    std::vector<std::string> names_;
+    std::unique_ptr<LatencyHistogram[]> histograms_;
+};
+
+/**
+ * @brief Counts the messages missing between consecutive header sequence numbers. A
+ * zero sequence number, which intra process publishers leave unset, and a sequence
+ * that goes backwards, a restarted publisher, only resynchronise.
+ *
+ */
+class SequenceGap {
+public:
+    /**
+     * @return uint32_t Number of messages skipped since the previous one
+     */
+    uint32_t update(uint32_t seq) {
+        if (seq == 0) {
+            return 0;
+        }
+        const uint32_t previous = last_;
+        last_ = seq;
+        if (previous == 0 || seq <= previous) {
+            return 0;
+        }
+        return seq - previous - 1;
+    }
+
+private:
+    uint32_t last_ = 0;
+};
+
+/**
+ * @brief Records the time between its construction and its destruction
+ *
+ */
+class ScopedStageTimer {
+public:
+    explicit ScopedStageTimer(LatencyHistogram& histogram)
+        : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+
+    ~ScopedStageTimer() {
+        histogram_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_).count());
+    }
+
+    ScopedStageTimer(const ScopedStageTimer&) = delete;
+    ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+
+private:
+    LatencyHistogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace pipeline_diagnostics
+
+#endif  // PIPELINE_DIAGNOSTICS_LATENCY_STATS_H
@@ -0,0 +1,153 @@
+/**
+ * @file stage_diagnostics.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Periodically publishes the stage latency histograms of a node on /diagnostics
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef PIPELINE_DIAGNOSTICS_STAGE_DIAGNOSTICS_H
+#define PIPELINE_DIAGNOSTICS_STAGE_DIAGNOSTICS_H
+
+#include <pipeline_diagnostics/latency_stats.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <ros/ros.h>
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pipeline_diagnostics {
+
+/**
+ * @brief Owns the stage histograms of a node. The hot path only records into them, a
+ * timer drains them every ~diagnostics_period seconds (default 1, 0 disables) and
+ * publishes count, mean, p50, p99 and max of every stage in one DiagnosticStatus.
+ * Optional counters, e.g. dropped messages, are published as running totals after the
+ * stages. A counter written with set() is a gauge instead, e.g. the occupancy of a
+ * message pool.
+ *
+ */
+class StageDiagnostics {
+public:
+    StageDiagnostics(ros::NodeHandle nh, ros::NodeHandle pnh, const std::string& name,
+                     std::vector<std::string> stages, std::vector<std::string> counters = {})
+        : stats_(std::move(stages)), counter_names_(std::move(counters)),
+          counters_(new std::atomic<uint64_t>[counter_names_.size()]) {
+        double period;
+        pnh.param("diagnostics_period", period, 1.0);
+        msg_.status.resize(1);
+        diagnostic_msgs::DiagnosticStatus& status = msg_.status[0];
+        status.name = name;
+        status.hardware_id = "voxl";
+        status.level = diagnostic_msgs::DiagnosticStatus::OK;
+        status.values.resize(stats_.size() * 5 + counter_names_.size());
+        for (size_t i = 0; i < stats_.size(); ++i) {
+            status.values[i * 5 + 0].key = stats_.name(i) + " count";
+            status.values[i * 5 + 1].key = stats_.name(i) + " mean_us";
+            status.values[i * 5 + 2].key = stats_.name(i) + " p50_us";
+            status.values[i * 5 + 3].key = stats_.name(i) + " p99_us";
+            status.values[i * 5 + 4].key = stats_.name(i) + " max_us";
+        }
+        for (size_t i = 0; i < counter_names_.size(); ++i) {
+            counters_[i].store(0, std::memory_order_relaxed);
+            status.values[stats_.size() * 5 + i].key = counter_names_[i];
+        }
+        if (period > 0.0) {
+            pub_ = nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10);
+            timer_ = nh.createTimer(ros::Duration(period), &StageDiagnostics::publish, this);
+        }
+    }
+
+    LatencyHistogram& operator[](size_t stage) { return stats_[stage]; }
+
+    /**
+     * @brief The histograms themselves, for code that records without knowing about ROS
+     *
+     */
+    StageStats& stats() { return stats_; }
+
+    /**
+     * @brief Adds n to a counter, safe from any thread
+     *
+     */
+    void count(size_t counter, uint64_t n = 1) {
+        if (n != 0) {
+            counters_[counter].fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Overwrites a counter, safe from any thread
+     *
+     */
+    void set(size_t counter, uint64_t value) { counters_[counter].store(value, std::memory_order_relaxed); }
+
+    /**
+     * @brief Names of the four gauges setPoolGauges writes for a pool
+     *
+     */
+    static std::vector<std::string> poolGauges(const std::string& pool) {
+        return {pool + " size", pool + " in_use", pool + " high_water", pool + " misses"};
+    }
+
+    /**
+     * @brief Sets the gauges of poolGauges, starting at counter first, from the stats of
+     * a MessagePool
+     *
+     */
+    template <typename PoolStats>
+    void setPoolGauges(size_t first, const PoolStats& stats) {
+        set(first, stats.size);
+        set(first + 1, stats.in_use);
+        set(first + 2, stats.high_water);
+        set(first + 3, stats.misses);
+    }
+
+    /**
+     * @brief Records the age of a message, from its header stamp to now
+     *
+     */
+    void recordAge(size_t stage, const ros::Time& stamp, const ros::Time& now) {
+        if (!stamp.isZero()) {
+            stats_[stage].record((now - stamp).toNSec());
+        }
+    }
+
+private:
+    void publish(const ros::TimerEvent&) {
+        diagnostic_msgs::DiagnosticStatus& status = msg_.status[0];
+        char buffer[32];
+        for (size_t i = 0; i < stats_.size(); ++i) {
+            const LatencyHistogram::Summary summary = stats_[i].drain();
+            const double values[5] = {static_cast<double>(summary.count), summary.mean_us, summary.p50_us,
+                                      summary.p99_us, summary.max_us};
+            for (int k = 0; k < 5; ++k) {
+                std::snprintf(buffer, sizeof(buffer), k == 0 ? "%.0f" : "%.1f", values[k]);
+                status.values[i * 5 + k].value = buffer;
+            }
+        }
+        for (size_t i = 0; i < counter_names_.size(); ++i) {
+            status.values[stats_.size() * 5 + i].value = std::to_string(counters_[i].load(std::memory_order_relaxed));
+        }
+        msg_.header.stamp = ros::Time::now();
+        pub_.publish(msg_);
+    }
+
+    StageStats stats_;
+    std::vector<std::string> counter_names_;
+    std::unique_ptr<std::atomic<uint64_t>[]> counters_;
+    ros::Publisher pub_;
+    ros::Timer timer_;
+    diagnostic_msgs::DiagnosticArray msg_;
+};
+
+}  // namespace pipeline_diagnostics
+
+#endif  // PIPELINE_DIAGNOSTICS_STAGE_DIAGNOSTICS_H
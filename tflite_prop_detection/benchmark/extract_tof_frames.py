@@ -0,0 +1,41 @@
+#!/usr/bin/env python
+"""
+Dumps the PointCloud2 messages of a bag into the frame file read by pipeline_benchmark.
+
+Per frame: seven little endian uint32 (width, height, point_step, row_step, offset_x,
+offset_y, offset_z) followed by the row_step * height bytes of the message data.
+
+    python extract_tof_frames.py recording.bag tof_frames.bin --topic /tof_pc --max 200
+"""
+import argparse
+import struct
+
+import rosbag
+from sensor_msgs.msg import PointField
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Extract ToF frames for pipeline_benchmark")
+    parser.add_argument("bag")
+    parser.add_argument("output")
+    parser.add_argument("--topic", default="/tof_pc")
+    parser.add_argument("--max", type=int, default=0, help="stop after this many frames, 0 for all")
+    args = parser.parse_args()
+
+    written = 0
+    with rosbag.Bag(args.bag) as bag, open(args.output, "wb") as out:
+        for _, msg, _ in bag.read_messages(topics=[args.topic]):
+            offsets = {f.name: f.offset for f in msg.fields if f.datatype == PointField.FLOAT32}
+            if msg.is_bigendian or not all(axis in offsets for axis in ("x", "y", "z")):
+                continue
+            out.write(struct.pack("<7I", msg.width, msg.height, msg.point_step, msg.row_step,
+                                  offsets["x"], offsets["y"], offsets["z"]))
+            out.write(msg.data[:msg.row_step * msg.height])
+            written += 1
+            if args.max and written >= args.max:
+                break
+    print("Wrote {} frames from {} to {}".format(written, args.topic, args.output))
+
+
+if __name__ == "__main__":
+    main()
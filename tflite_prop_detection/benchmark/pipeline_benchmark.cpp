@@ -0,0 +1,618 @@
+/**
+ * @file pipeline_benchmark.cpp
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Google Benchmark harness for the ToF point cloud kernels of the transform and
+ * detection stages (filter, transform, project, gate, centroid). Runs without a roscore
+ * on synthetic 224 x 172 ToF frames and, when a frame file written by
+ * extract_tof_frames.py is passed as the first argument, on frames recorded in a bag.
+ *
+ * Every benchmark reports the time per point, the p50 and p99 frame latency and the
+ * heap allocations per frame. The filter and transform benchmark is repeated for a
+ * growing number of workers to show the thread scaling.
+ *
+ *   ./pipeline_benchmark [frames.bin] [--benchmark_filter=...]
+ *
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <benchmark/benchmark.h>
+#include <tflite_prop_detection/bbox_gate.h>
+#include <tflite_prop_detection/camera_projection.h>
+#include <tflite_prop_detection/cluster_grid.h>
+#include <tflite_prop_detection/depth_estimator.h>
+#include <tflite_prop_detection/multi_bbox_gate.h>
+#include <tflite_prop_detection/organized_roi.h>
+#include <your_pointcloud_package/cloud_downsample.h>
+#include <your_pointcloud_package/tiled_filter_transform.h>
+#include <your_pointcloud_package/tof_filter_transform.h>
+#include <your_pointcloud_package/worker_pool.h>
+#include <Eigen/Geometry>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Every heap allocation of the process is counted, the benchmarks report the ones
+// made inside their timed loop
+static std::atomic<uint64_t> g_allocations{0};
+
+void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    const std::size_t align = static_cast<std::size_t>(alignment);
+    if (void* p = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// GCC cannot tell that the replaced operator new above is the malloc behind these
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpragmas"
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+#pragma GCC diagnostic pop
+
+namespace {
+
+using your_pointcloud_package::CloudLayout;
+using your_pointcloud_package::PacketTransform;
+using your_pointcloud_package::TofGate;
+using your_pointcloud_package::WorkerPool;
+using your_pointcloud_package::kOutputPointStep;
+using namespace tflite_prop_detection;
+
+// VOXL ToF resolution and the hires camera of the detection node
+constexpr uint32_t kTofWidth = 224;
+constexpr uint32_t kTofHeight = 172;
+constexpr float kHiresFx = 756.3252575983485f;
+constexpr float kHiresFy = 751.995016895224f;
+constexpr float kHiresCx = 512.0f;
+constexpr float kHiresCy = 384.0f;
+
+struct Frame {
+    CloudLayout layout;
+    std::vector<uint8_t> data;
+};
+
+/**
+ * @brief Raw ToF frames and the same frames after the filter and world->hires transform
+ *
+ */
+struct FrameSet {
+    std::string name;
+    std::vector<Frame> raw;
+    std::vector<Frame> hires;
+};
+
+/**
+ * @brief ToF to hires extrinsic used for the synthetic frames and for the raw projection
+ *
+ */
+Eigen::Matrix<float, 3, 4> tofToHires() {
+    Eigen::Matrix<float, 3, 4> T;
+    T.leftCols<3>() = Eigen::AngleAxisf(0.02f, Eigen::Vector3f::UnitY()).toRotationMatrix();
+    T.col(3) = Eigen::Vector3f(0.025f, -0.012f, 0.004f);
+    return T;
+}
+
+/**
+ * @brief Organized 224 x 172 frame of a pinhole ToF camera looking at a wall 1.3 m away
+ * with a drone sized target at 0.8 m in the middle. A few percent of the pixels have no
+ * return (all zero) or are NaN, the corners are beyond the z gate.
+ *
+ */
+Frame syntheticTofFrame(uint32_t seed) {
+    constexpr float kFx = 110.0f;
+    constexpr float kFy = 110.0f;
+    Frame frame;
+    frame.layout.point_step = 16;
+    frame.layout.width = kTofWidth;
+    frame.layout.height = kTofHeight;
+    frame.layout.row_step = kTofWidth * 16;
+    frame.data.resize(frame.layout.row_step * kTofHeight);
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.0f, 0.005f);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    const float target_u = kTofWidth / 2.0f + 4.0f * std::sin(0.3f * seed);
+    const float target_v = kTofHeight / 2.0f + 3.0f * std::cos(0.3f * seed);
+    for (uint32_t v = 0; v < kTofHeight; ++v) {
+        for (uint32_t u = 0; u < kTofWidth; ++u) {
+            const float du = u - target_u;
+            const float dv = v - target_v;
+            float z = du * du + dv * dv < 35.0f * 35.0f ? 0.8f : 1.3f;
+            if (std::abs(du) > 95.0f && std::abs(dv) > 70.0f) {
+                z = 2.0f;
+            }
+            z += noise(rng);
+            float point[4] = {(u - kTofWidth / 2.0f) * z / kFx, (v - kTofHeight / 2.0f) * z / kFy, z, 1.0f};
+            const float dropout = uniform(rng);
+            if (dropout < 0.06f) {
+                point[0] = point[1] = point[2] = 0.0f;
+            } else if (dropout < 0.07f) {
+                point[0] = point[1] = point[2] = std::numeric_limits<float>::quiet_NaN();
+            }
+            std::memcpy(frame.data.data() + v * frame.layout.row_step + u * 16, point, sizeof(point));
+        }
+    }
+    return frame;
+}
+
+/**
+ * @brief Reads the frames written by extract_tof_frames.py: per frame seven little
+ * endian uint32 (width, height, point_step, row_step, offset_x, offset_y, offset_z)
+ * followed by row_step * height bytes of point data
+ *
+ */
+bool loadFrames(const std::string& path, std::vector<Frame>& frames) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    uint32_t header[7];
+    while (file.read(reinterpret_cast<char*>(header), sizeof(header))) {
+        Frame frame;
+        frame.layout.width = header[0];
+        frame.layout.height = header[1];
+        frame.layout.point_step = header[2];
+        frame.layout.row_step = header[3];
+        frame.layout.offset_x = header[4];
+        frame.layout.offset_y = header[5];
+        frame.layout.offset_z = header[6];
+        frame.data.resize(static_cast<size_t>(frame.layout.row_step) * frame.layout.height);
+        if (!layoutFits(frame.layout, frame.data.size()) ||
+            !file.read(reinterpret_cast<char*>(frame.data.data()), frame.data.size())) {
+            return false;
+        }
+        frames.push_back(std::move(frame));
+    }
+    return !frames.empty();
+}
+
+/**
+ * @brief The /rgb_pcl cloud the transform stage publishes for a raw frame
+ *
+ */
+Frame toHires(const Frame& raw) {
+    Frame frame;
+    frame.data.resize(raw.layout.size() * kOutputPointStep);
+    const size_t n = your_pointcloud_package::filterTransformTof(raw.data.data(), raw.layout, 0, raw.layout.size(),
+                                                                 PacketTransform(tofToHires()), TofGate(),
+                                                                 frame.data.data());
+    frame.data.resize(n * kOutputPointStep);
+    frame.layout.point_step = kOutputPointStep;
+    frame.layout.width = n;
+    frame.layout.height = 1;
+    frame.layout.row_step = n * kOutputPointStep;
+    return frame;
+}
+
+FrameSet makeFrameSet(const std::string& name, std::vector<Frame> raw) {
+    FrameSet set;
+    set.name = name;
+    set.raw = std::move(raw);
+    for (const Frame& frame : set.raw) {
+        set.hires.push_back(toHires(frame));
+    }
+    return set;
+}
+
+CameraProjection hiresProjection() {
+    CameraProjection projection;
+    projection.set(kHiresFx, kHiresFy, kHiresCx, kHiresCy, 1000.0f, Eigen::Matrix<float, 3, 4>::Identity());
+    return projection;
+}
+
+CameraProjection tofProjection() {
+    CameraProjection projection;
+    projection.set(kHiresFx, kHiresFy, kHiresCx, kHiresCy, 1000.0f, tofToHires());
+    return projection;
+}
+
+// Box around the synthetic target as the detector would report it
+constexpr BoundingBox kTargetBox{400.0f, 280.0f, 624.0f, 488.0f};
+
+/**
+ * @brief n boxes spread over the hires image, the first one on the target
+ *
+ */
+std::vector<BoundingBox> spreadBoxes(size_t n) {
+    std::vector<BoundingBox> boxes{kTargetBox};
+    for (size_t i = 1; i < n; ++i) {
+        const float x = 40.0f + 150.0f * (i % 6);
+        const float y = 40.0f + 240.0f * ((i / 6) % 3);
+        boxes.push_back(BoundingBox{x, y, x + 180.0f, y + 160.0f});
+    }
+    return boxes;
+}
+
+/**
+ * @brief Times fn once per frame, cycling through the frames, and reports the time per
+ * point, the p50 / p99 frame latency and the allocations per frame
+ *
+ */
+template <typename Fn>
+void runFrames(benchmark::State& state, const std::vector<Frame>& frames, Fn&& fn) {
+    constexpr size_t kMaxSamples = 1 << 20;
+    std::vector<double> latencies_us;
+    latencies_us.reserve(kMaxSamples);
+    size_t points = 0;
+    size_t next = 0;
+    const uint64_t allocations_before = g_allocations.load(std::memory_order_relaxed);
+    for (auto _ : state) {
+        const Frame& frame = frames[next];
+        next = next + 1 == frames.size() ? 0 : next + 1;
+        const auto start = std::chrono::steady_clock::now();
+        fn(frame);
+        const auto stop = std::chrono::steady_clock::now();
+        if (latencies_us.size() < kMaxSamples) {
+            latencies_us.push_back(std::chrono::duration<double, std::micro>(stop - start).count());
+        }
+        points += frame.layout.size();
+    }
+    const uint64_t allocations = g_allocations.load(std::memory_order_relaxed) - allocations_before;
+    const auto percentile = [&latencies_us](double q) {
+        if (latencies_us.empty()) {
+            return 0.0;
+        }
+        const size_t k = std::min(latencies_us.size() - 1, static_cast<size_t>(q * latencies_us.size()));
+        std::nth_element(latencies_us.begin(), latencies_us.begin() + k, latencies_us.end());
+        return latencies_us[k];
+    };
+    state.SetItemsProcessed(points);
+    state.counters["per_point"] = benchmark::Counter(points, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+    state.counters["p50_us"] = percentile(0.50);
+    state.counters["p99_us"] = percentile(0.99);
+    state.counters["allocs_per_frame"] =
+        static_cast<double>(allocations) / static_cast<double>(std::max<int64_t>(state.iterations(), 1));
+}
+
+/**
+ * @brief Transform stage: filter and world->hires transform into the message buffer,
+ * serial for 0 workers, otherwise tiled on a pool with that many unpinned workers
+ * besides the caller
+ *
+ */
+void filterTransform(benchmark::State& state, const FrameSet* set) {
+    const size_t workers = static_cast<size_t>(state.range(0));
+    std::unique_ptr<WorkerPool> pool;
+    if (workers > 0) {
+        pool.reset(new WorkerPool(std::vector<int>(workers, 0)));
+    }
+    std::vector<size_t> tile_counts;
+    tile_counts.reserve(64);
+    std::vector<uint8_t> scratch(kTofWidth * kTofHeight * kOutputPointStep);
+    std::vector<uint8_t> out;
+    out.reserve(kTofWidth * kTofHeight * kOutputPointStep);
+    const PacketTransform T(tofToHires());
+    const TofGate gate;
+    size_t n_out = 0;
+    runFrames(state, set->raw, [&](const Frame& frame) {
+        n_out = your_pointcloud_package::filterTransformTiled(pool.get(), tile_counts, 1024, 0, frame.data.data(),
+                                                              frame.layout, T, gate, scratch, out);
+        benchmark::DoNotOptimize(n_out);
+    });
+}
+
+/**
+ * @brief Transform stage with downsampling on one thread: mode 1 is a stride of 2 over
+ * the organized input, mode 2 a 2 cm voxel grid over the output. Reports the points
+ * left per frame.
+ *
+ */
+void downsample(benchmark::State& state, const FrameSet* set) {
+    using your_pointcloud_package::DownsampleMode;
+    const DownsampleMode mode = static_cast<DownsampleMode>(state.range(0));
+    std::vector<size_t> tile_counts;
+    std::vector<uint8_t> scratch(kTofWidth * kTofHeight * kOutputPointStep);
+    std::vector<uint8_t> out;
+    out.reserve(kTofWidth * kTofHeight * kOutputPointStep);
+    your_pointcloud_package::VoxelGrid grid(kTofWidth * kTofHeight);
+    const PacketTransform T(tofToHires());
+    const TofGate gate;
+    size_t n_out = 0;
+    size_t frames = 0;
+    runFrames(state, set->raw, [&](const Frame& frame) {
+        const CloudLayout layout = mode == DownsampleMode::kStride
+                                       ? your_pointcloud_package::stridedLayout(frame.layout, 2)
+                                       : frame.layout;
+        size_t n = your_pointcloud_package::filterTransformTiled(nullptr, tile_counts, 1024, 0, frame.data.data(),
+                                                                 layout, T, gate, scratch, out);
+        if (mode == DownsampleMode::kVoxel) {
+            n = grid.downsample(out.data(), n, 0.02f);
+        }
+        n_out += n;
+        ++frames;
+        benchmark::DoNotOptimize(n);
+    });
+    state.counters["points_out"] = static_cast<double>(n_out) / static_cast<double>(std::max<size_t>(frames, 1));
+}
+
+/**
+ * @brief Runs fn with the compiled in field reader of the layout, or with the runtime
+ * offset reader every layout falls back to
+ *
+ */
+template <typename Fn>
+void withFields(bool specialized, const CloudLayout& layout, Fn&& fn) {
+    if (specialized) {
+        your_pointcloud_package::withPointFields(layout, fn);
+    } else {
+        fn(your_pointcloud_package::RuntimeFields(layout));
+    }
+}
+
+/**
+ * @brief Serial filter and transform, specialized 0 reads the fields through the runtime
+ * offsets, 1 through the reader compiled for the layout of the frames
+ *
+ */
+void filterFields(benchmark::State& state, const FrameSet* set) {
+    const bool specialized = state.range(0) != 0;
+    std::vector<uint8_t> out(kTofWidth * kTofHeight * kOutputPointStep);
+    const PacketTransform T(tofToHires());
+    const TofGate gate;
+    runFrames(state, set->raw, [&](const Frame& frame) {
+        if (out.size() < frame.layout.size() * kOutputPointStep) {
+            out.resize(frame.layout.size() * kOutputPointStep);
+        }
+        withFields(specialized, frame.layout, [&](const auto& fields) {
+            const size_t n = your_pointcloud_package::filterTransformTof(frame.data.data(), frame.layout, fields, 0,
+                                                                         frame.layout.size(), T, gate, out.data());
+            benchmark::DoNotOptimize(n);
+        });
+    });
+}
+
+/**
+ * @brief gate_tof with the field reader picked like filter_fields. The gates ship with
+ * RuntimeFields, specialized 1 shows what the packed readers would do there.
+ *
+ */
+void gateTofFields(benchmark::State& state, const FrameSet* set) {
+    const bool specialized = state.range(0) != 0;
+    const CameraProjection projection = tofProjection();
+    const TofGate gate;
+    GateMoments moments;
+    moments.reference = Eigen::Vector3d(0.0, 0.0, 1000.0);
+    runFrames(state, set->raw, [&](const Frame& frame) {
+        withFields(specialized, frame.layout, [&](const auto& fields) {
+            gateAndAccumulate(frame.data.data(), frame.layout, fields, projection, kTargetBox, &gate, moments);
+        });
+        Eigen::Vector3f centroid = moments.centroid();
+        benchmark::DoNotOptimize(centroid);
+    });
+}
+
+/**
+ * @brief Detection stage on /rgb_pcl: project, gate one box and take the centroid
+ *
+ */
+void gateHires(benchmark::State& state, const FrameSet* set) {
+    const CameraProjection projection = hiresProjection();
+    GateMoments moments;
+    moments.reference = Eigen::Vector3d(0.0, 0.0, 1000.0);
+    runFrames(state, set->hires, [&](const Frame& frame) {
+        gateAndAccumulate(frame.data.data(), frame.layout, projection, kTargetBox, nullptr, moments);
+        Eigen::Vector3f centroid = moments.centroid();
+        benchmark::DoNotOptimize(centroid);
+    });
+}
+
+/**
+ * @brief Detection stage on the raw /tof_pc with the extrinsic folded into the projection
+ *
+ */
+void gateTof(benchmark::State& state, const FrameSet* set) {
+    const CameraProjection projection = tofProjection();
+    const TofGate gate;
+    GateMoments moments;
+    moments.reference = Eigen::Vector3d(0.0, 0.0, 1000.0);
+    runFrames(state, set->raw, [&](const Frame& frame) {
+        gateAndAccumulate(frame.data.data(), frame.layout, projection, kTargetBox, &gate, moments);
+        Eigen::Vector3f centroid = moments.centroid();
+        benchmark::DoNotOptimize(centroid);
+    });
+}
+
+/**
+ * @brief gate_tof restricted to the window of ToF pixels that can reach the box, with
+ * the sensor model fitted once up front like the node does
+ *
+ */
+void gateTofRoi(benchmark::State& state, const FrameSet* set) {
+    const CameraProjection projection = tofProjection();
+    const TofGate gate;
+    OrganizedPinhole sensor;
+    sensor.fit(set->raw[0].data.data(), set->raw[0].layout);
+    GateMoments moments;
+    moments.reference = Eigen::Vector3d(0.0, 0.0, 1000.0);
+    runFrames(state, set->raw, [&](const Frame& frame) {
+        PixelWindow window;
+        CloudLayout layout = frame.layout;
+        size_t offset = 0;
+        if (sensor.matches(frame.layout) &&
+            bboxWindow(sensor, projection, kTargetBox, (gate.z_min - 0.1f) * 1000.0f, (gate.z_max + 0.1f) * 1000.0f,
+                       2.0f, window)) {
+            layout = windowLayout(frame.layout, window, offset);
+        }
+        gateAndAccumulate(frame.data.data() + offset, layout, projection, kTargetBox, &gate, moments);
+        Eigen::Vector3f centroid = moments.centroid();
+        benchmark::DoNotOptimize(centroid);
+    });
+}
+
+/**
+ * @brief Detection stage with the robust estimators: gate with the depth histogram and
+ * read the mode, median and trimmed mean
+ *
+ */
+void gateEstimators(benchmark::State& state, const FrameSet* set) {
+    const CameraProjection projection = hiresProjection();
+    GateMoments moments;
+    moments.reference = Eigen::Vector3d(0.0, 0.0, 1000.0);
+    DepthHistogram histogram;
+    runFrames(state, set->hires, [&](const Frame& frame) {
+        gateAndAccumulate(frame.data.data(), frame.layout, projection, kTargetBox, nullptr, moments, &histogram);
+        Eigen::Vector3f mode = estimateMode(histogram);
+        Eigen::Vector3f median = estimateMedian(histogram, moments.count);
+        Eigen::Vector3f trimmed = estimateTrimmedMean(histogram, moments.count, 0.1f);
+        benchmark::DoNotOptimize(mode);
+        benchmark::DoNotOptimize(median);
+        benchmark::DoNotOptimize(trimmed);
+    });
+}
+
+/**
+ * @brief Detection stage with clustering: gate keeping the points, cluster them on the
+ * hashed grid with a 50 mm tolerance and pick the cluster in the middle of the box
+ *
+ */
+void gateCluster(benchmark::State& state, const FrameSet* set) {
+    const CameraProjection projection = hiresProjection();
+    GateMoments moments;
+    moments.reference = Eigen::Vector3d(0.0, 0.0, 1000.0);
+    GatedPoints points;
+    points.reserve(8192);
+    ClusterGrid grid(8192);
+    size_t gated = 0;
+    size_t clusters = 0;
+    size_t frames = 0;
+    runFrames(state, set->hires, [&](const Frame& frame) {
+        gateAndAccumulate(frame.data.data(), frame.layout, projection, kTargetBox, nullptr, moments, nullptr,
+                          &points);
+        clusters += grid.cluster(points.points.data(), points.size, 50.0f);
+        int selected = grid.select(ClusterSelection::kCenter, points.points.data(), projection, kTargetBox, 5);
+        benchmark::DoNotOptimize(selected);
+        gated += points.size;
+        ++frames;
+    });
+    state.counters["gated_points"] = static_cast<double>(gated) / static_cast<double>(std::max<size_t>(frames, 1));
+    state.counters["clusters"] = static_cast<double>(clusters) / static_cast<double>(std::max<size_t>(frames, 1));
+}
+
+/**
+ * @brief Detection stage with several detections gated through the tiled box index
+ *
+ */
+void gateMulti(benchmark::State& state, const FrameSet* set) {
+    const CameraProjection projection = hiresProjection();
+    const std::vector<BoundingBox> boxes = spreadBoxes(static_cast<size_t>(state.range(0)));
+    std::vector<GateMoments> moments(boxes.size());
+    TiledBoxIndex index;
+    index.resize(1024, 768, 32);
+    runFrames(state, set->hires, [&](const Frame& frame) {
+        index.build(boxes.data(), boxes.size());
+        gateAndAccumulateMulti(frame.data.data(), frame.layout, projection, boxes.data(), boxes.size(), index,
+                               nullptr, moments.data());
+        benchmark::DoNotOptimize(moments.data());
+    });
+}
+
+/**
+ * @brief Both stages back to back on one thread, /tof_pc in, centroid out
+ *
+ */
+void pipeline(benchmark::State& state, const FrameSet* set) {
+    const PacketTransform T(tofToHires());
+    const TofGate gate;
+    const CameraProjection projection = hiresProjection();
+    std::vector<size_t> tile_counts;
+    std::vector<uint8_t> scratch(kTofWidth * kTofHeight * kOutputPointStep);
+    std::vector<uint8_t> out;
+    out.reserve(kTofWidth * kTofHeight * kOutputPointStep);
+    GateMoments moments;
+    moments.reference = Eigen::Vector3d(0.0, 0.0, 1000.0);
+    runFrames(state, set->raw, [&](const Frame& frame) {
+        const size_t n = your_pointcloud_package::filterTransformTiled(nullptr, tile_counts, 1024, 0,
+                                                                       frame.data.data(), frame.layout, T, gate,
+                                                                       scratch, out);
+        CloudLayout hires;
+        hires.point_step = kOutputPointStep;
+        hires.width = n;
+        hires.height = 1;
+        hires.row_step = n * kOutputPointStep;
+        gateAndAccumulate(out.data(), hires, projection, kTargetBox, nullptr, moments);
+        Eigen::Vector3f centroid = moments.centroid();
+        benchmark::DoNotOptimize(centroid);
+    });
+}
+
+void registerBenchmarks(const FrameSet* set) {
+    const std::string suffix = "/" + set->name;
+    auto* scaling = benchmark::RegisterBenchmark(("filter_transform" + suffix).c_str(), filterTransform, set);
+    const int max_workers = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    for (int workers = 0; workers <= std::min(max_workers, 7); ++workers) {
+        scaling->Arg(workers);
+    }
+    scaling->ArgName("workers")->UseRealTime();
+    benchmark::RegisterBenchmark(("downsample" + suffix).c_str(), downsample, set)
+        ->ArgName("mode")->Arg(static_cast<int>(your_pointcloud_package::DownsampleMode::kStride))
+        ->Arg(static_cast<int>(your_pointcloud_package::DownsampleMode::kVoxel));
+    benchmark::RegisterBenchmark(("filter_fields" + suffix).c_str(), filterFields, set)
+        ->ArgName("specialized")->Arg(0)->Arg(1);
+    benchmark::RegisterBenchmark(("gate_tof_fields" + suffix).c_str(), gateTofFields, set)
+        ->ArgName("specialized")->Arg(0)->Arg(1);
+    benchmark::RegisterBenchmark(("gate_hires" + suffix).c_str(), gateHires, set);
+    benchmark::RegisterBenchmark(("gate_tof" + suffix).c_str(), gateTof, set);
+    benchmark::RegisterBenchmark(("gate_tof_roi" + suffix).c_str(), gateTofRoi, set);
+    benchmark::RegisterBenchmark(("gate_estimators" + suffix).c_str(), gateEstimators, set);
+    benchmark::RegisterBenchmark(("gate_cluster" + suffix).c_str(), gateCluster, set);
+    benchmark::RegisterBenchmark(("gate_multi" + suffix).c_str(), gateMulti, set)
+        ->ArgName("boxes")->Arg(2)->Arg(4)->Arg(8)->Arg(16);
+    benchmark::RegisterBenchmark(("pipeline" + suffix).c_str(), pipeline, set);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    std::vector<Frame> synthetic;
+    for (uint32_t seed = 0; seed < 16; ++seed) {
+        synthetic.push_back(syntheticTofFrame(seed));
+    }
+    // Kept alive until the benchmarks ran, they hold pointers into the sets
+    std::vector<std::unique_ptr<FrameSet>> sets;
+    sets.emplace_back(new FrameSet(makeFrameSet("synthetic", std::move(synthetic))));
+    if (argc > 1) {
+        std::vector<Frame> recorded;
+        if (!loadFrames(argv[1], recorded)) {
+            std::fprintf(stderr, "Could not read ToF frames from %s\n", argv[1]);
+            return 1;
+        }
+        sets.emplace_back(new FrameSet(makeFrameSet("bag", std::move(recorded))));
+    }
+    for (const auto& set : sets) {
+        registerBenchmarks(set.get());
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
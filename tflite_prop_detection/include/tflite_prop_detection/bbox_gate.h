@@ -0,0 +1,278 @@
+/**
+ * @file bbox_gate.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Streaming kernel that projects the points of a PointCloud2 buffer, keeps the
+ * ones inside the detection bounding box and accumulates their back projected centroid
+ * and covariance without storing them
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef TFLITE_PROP_DETECTION_BBOX_GATE_H
+#define TFLITE_PROP_DETECTION_BBOX_GATE_H
+
+#include <tflite_prop_detection/camera_projection.h>
+#include <tflite_prop_detection/depth_estimator.h>
+#include <your_pointcloud_package/tof_filter_transform.h>
+#include <Eigen/Core>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tflite_prop_detection {
+
+/**
+ * @brief Detection bounding box in hires pixels. A point is inside when it lies strictly
+ * between the bounds.
+ *
+ */
+struct BoundingBox {
+    float x_min;
+    float y_min;
+    float x_max;
+    float y_max;
+};
+
+/**
+ * @brief Intersection over union of two boxes, 0 when either is empty
+ *
+ */
+inline float intersectionOverUnion(const BoundingBox& a, const BoundingBox& b) {
+    const float iw = std::min(a.x_max, b.x_max) - std::max(a.x_min, b.x_min);
+    const float ih = std::min(a.y_max, b.y_max) - std::max(a.y_min, b.y_min);
+    if (iw <= 0.0f || ih <= 0.0f) {
+        return 0.0f;
+    }
+    const float inter = iw * ih;
+    const float area_a = (a.x_max - a.x_min) * (a.y_max - a.y_min);
+    const float area_b = (b.x_max - b.x_min) * (b.y_max - b.y_min);
+    return inter / (area_a + area_b - inter);
+}
+
+/**
+ * @brief First and second moments of the gated points in the hires camera frame (mm).
+ * The sums are taken relative to a reference point close to the target, which keeps the
+ * float lane sums precise enough for the covariance.
+ *
+ */
+struct GateMoments {
+    size_t count = 0;
+    Eigen::Vector3d reference = Eigen::Vector3d::Zero();
+    Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+    Eigen::Matrix3d sum_sq = Eigen::Matrix3d::Zero();
+
+    Eigen::Vector3f centroid() const {
+        return (reference + sum / static_cast<double>(count)).cast<float>();
+    }
+
+    Eigen::Matrix3f covariance() const {
+        const Eigen::Vector3d mean = sum / static_cast<double>(count);
+        return (sum_sq / static_cast<double>(count) - mean * mean.transpose()).cast<float>();
+    }
+};
+
+/**
+ * @brief The gated points themselves, in the hires camera frame (mm), for the stages that
+ * need more than the moments. The buffer is sized once, points past the capacity are
+ * only counted.
+ *
+ */
+struct GatedPoints {
+    std::vector<Eigen::Vector3f> points;
+    size_t size = 0;
+    size_t dropped = 0;
+
+    void reserve(size_t capacity) { points.resize(capacity); }
+
+    void clear() {
+        size = 0;
+        dropped = 0;
+    }
+
+    void add(float x, float y, float z) {
+        if (size < points.size()) {
+            points[size++] = Eigen::Vector3f(x, y, z);
+        } else {
+            ++dropped;
+        }
+    }
+};
+
+namespace detail {
+
+/**
+ * @brief Per lane running sums for four points at a time
+ *
+ */
+struct LaneSums {
+    Eigen::Array4f n, sx, sy, sz, sxx, sxy, sxz, syy, syz, szz;
+
+    LaneSums() { clear(); }
+
+    void clear() {
+        n.setZero(); sx.setZero(); sy.setZero(); sz.setZero();
+        sxx.setZero(); sxy.setZero(); sxz.setZero(); syy.setZero(); syz.setZero(); szz.setZero();
+    }
+
+    void flushInto(GateMoments& moments) {
+        moments.count += static_cast<size_t>(n.sum() + 0.5f);
+        moments.sum += Eigen::Vector3d(sx.sum(), sy.sum(), sz.sum());
+        moments.sum_sq(0, 0) += sxx.sum();
+        moments.sum_sq(1, 1) += syy.sum();
+        moments.sum_sq(2, 2) += szz.sum();
+        moments.sum_sq(0, 1) += sxy.sum();
+        moments.sum_sq(0, 2) += sxz.sum();
+        moments.sum_sq(1, 2) += syz.sum();
+        moments.sum_sq(1, 0) = moments.sum_sq(0, 1);
+        moments.sum_sq(2, 0) = moments.sum_sq(0, 2);
+        moments.sum_sq(2, 1) = moments.sum_sq(1, 2);
+        clear();
+    }
+};
+
+}  // namespace detail
+
+/**
+ * @brief Reads the cloud once and accumulates the back projected points whose projection
+ * lands inside box. Four points are processed per step: the projection, the bbox test
+ * and the masked accumulation run on Eigen 4 float packets, the only scalar work is
+ * gathering x, y, z out of the interleaved buffer.
+ *
+ * @param data Start of the PointCloud2 data buffer
+ * @param layout Layout of the cloud
+ * @param fields Field reader matching layout, see your_pointcloud_package::RuntimeFields
+ * @param projection Fused camera matrix for the frame of the cloud
+ * @param box Bounding box in hires pixels
+ * @param tof_gate Gate on the raw ToF z value, null when the cloud is already filtered
+ * @param moments Filled with the moments of the gated points, relative to moments.reference
+ * @param histogram Filled with the depth histogram of the gated points, null to skip it
+ * @param points Filled with the gated points, null to skip them
+ */
+template <typename Fields>
+void gateAndAccumulate(const uint8_t* data, const your_pointcloud_package::CloudLayout& layout, const Fields& fields,
+                       const CameraProjection& projection, const BoundingBox& box,
+                       const your_pointcloud_package::TofGate* tof_gate, GateMoments& moments,
+                       DepthHistogram* histogram = nullptr, GatedPoints* points = nullptr) {
+    using your_pointcloud_package::isFiniteBits;
+    const Eigen::Matrix<float, 3, 4>& P = projection.matrix();
+    const float inv_fx = 1.0f / projection.fx();
+    const float inv_fy = 1.0f / projection.fy();
+    const Eigen::Array4f ref_x = Eigen::Array4f::Constant(static_cast<float>(moments.reference.x()));
+    const Eigen::Array4f ref_y = Eigen::Array4f::Constant(static_cast<float>(moments.reference.y()));
+    const Eigen::Array4f ref_z = Eigen::Array4f::Constant(static_cast<float>(moments.reference.z()));
+    moments.count = 0;
+    moments.sum.setZero();
+    moments.sum_sq.setZero();
+    if (histogram != nullptr) {
+        histogram->clear();
+    }
+    if (points != nullptr) {
+        points->clear();
+    }
+    detail::LaneSums lanes;
+    // Float lane sums are flushed into the double moments every few hundred points
+    constexpr int kFlushBlocks = 64;
+    int blocks = 0;
+    Eigen::Array4f x, y, z, valid;
+    for (size_t row = 0; row < layout.height; ++row) {
+        const uint8_t* row_ptr = data + row * layout.row_step;
+        for (size_t col = 0; col < layout.width; col += 4) {
+            for (int lane = 0; lane < 4; ++lane) {
+                x[lane] = 0.0f;
+                y[lane] = 0.0f;
+                z[lane] = 0.0f;
+                valid[lane] = 0.0f;
+                if (col + lane >= layout.width) {
+                    continue;
+                }
+                float px, py, pz;
+                fields.load(row_ptr + (col + lane) * fields.step(), px, py, pz);
+                if (!(isFiniteBits(px) && isFiniteBits(py) && isFiniteBits(pz))) {
+                    continue;
+                }
+                // Also drops the all zero points of the pixels without a return, z_min > 0
+                if (tof_gate != nullptr && (pz < tof_gate->z_min || pz > tof_gate->z_max)) {
+                    continue;
+                }
+                // Rejected lanes stay at the origin so the packet math below never sees a NaN
+                x[lane] = px;
+                y[lane] = py;
+                z[lane] = pz;
+                valid[lane] = 1.0f;
+            }
+            const Eigen::Array4f hu = P(0, 0) * x + P(0, 1) * y + P(0, 2) * z + P(0, 3);
+            const Eigen::Array4f hv = P(1, 0) * x + P(1, 1) * y + P(1, 2) * z + P(1, 3);
+            const Eigen::Array4f d = P(2, 0) * x + P(2, 1) * y + P(2, 2) * z + P(2, 3);
+            // A zero depth only happens on rejected lanes, their weight is forced to zero
+            const Eigen::Array4f safe_d = (d == 0.0f).select(Eigen::Array4f::Ones(), d);
+            const Eigen::Array4f inv_d = safe_d.inverse();
+            const Eigen::Array4f u = hu * inv_d;
+            const Eigen::Array4f v = hv * inv_d;
+            const Eigen::Array4f w =
+                ((u > box.x_min) && (u < box.x_max) && (v > box.y_min) && (v < box.y_max) && (d > 0.0f))
+                    .cast<float>() * valid;
+            // Back projection without a division: (u - cx) * d / fx == (hu - cx * d) / fx
+            const Eigen::Array4f bx = (hu - projection.cx() * d) * inv_fx - ref_x;
+            const Eigen::Array4f by = (hv - projection.cy() * d) * inv_fy - ref_y;
+            const Eigen::Array4f bz = d - ref_z;
+            const Eigen::Array4f wx = w * bx;
+            const Eigen::Array4f wy = w * by;
+            const Eigen::Array4f wz = w * bz;
+            lanes.n += w;
+            lanes.sx += wx;
+            lanes.sy += wy;
+            lanes.sz += wz;
+            lanes.sxx += wx * bx;
+            lanes.sxy += wx * by;
+            lanes.sxz += wx * bz;
+            lanes.syy += wy * by;
+            lanes.syz += wy * bz;
+            lanes.szz += wz * bz;
+            if (histogram != nullptr || points != nullptr) {
+                // The scatter into the bins and the points is the only per lane branch of
+                // the kernel
+                for (int lane = 0; lane < 4; ++lane) {
+                    if (w[lane] == 0.0f) {
+                        continue;
+                    }
+                    const float gx = bx[lane] + ref_x[lane];
+                    const float gy = by[lane] + ref_y[lane];
+                    if (histogram != nullptr) {
+                        histogram->add(gx, gy, d[lane]);
+                    }
+                    if (points != nullptr) {
+                        points->add(gx, gy, d[lane]);
+                    }
+                }
+            }
+            if (++blocks == kFlushBlocks) {
+                lanes.flushInto(moments);
+                blocks = 0;
+            }
+        }
+    }
+    lanes.flushInto(moments);
+}
+
+/**
+ * @brief gateAndAccumulate through the runtime field offsets. The packed readers of the
+ * filter do not pay off here: the lanes of a packet are gathered point by point anyway,
+ * and on the synthetic frames they measured 3 to 9 % slower.
+ *
+ */
+inline void gateAndAccumulate(const uint8_t* data, const your_pointcloud_package::CloudLayout& layout,
+                              const CameraProjection& projection, const BoundingBox& box,
+                              const your_pointcloud_package::TofGate* tof_gate, GateMoments& moments,
+                              DepthHistogram* histogram = nullptr, GatedPoints* points = nullptr) {
+    gateAndAccumulate(data, layout, your_pointcloud_package::RuntimeFields(layout), projection, box, tof_gate,
+                      moments, histogram, points);
+}
+
+}  // namespace tflite_prop_detection
+
+#endif  // TFLITE_PROP_DETECTION_BBOX_GATE_H
@@ -0,0 +1,115 @@
+/**
+ * @file camera_projection.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Single precomputed 3x4 camera matrix that folds the extrinsic, the metre to
+ * millimetre scaling and the hires intrinsics into one projection
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef TFLITE_PROP_DETECTION_CAMERA_PROJECTION_H
+#define TFLITE_PROP_DETECTION_CAMERA_PROJECTION_H
+
+#include <Eigen/Core>
+
+namespace tflite_prop_detection {
+
+/**
+ * @brief Projection of one point: pixel coordinates and depth along the hires optical
+ * axis in millimetres
+ *
+ */
+struct ProjectedPoint {
+    float u;
+    float v;
+    float depth;
+};
+
+/**
+ * @brief Fused camera matrix P with (u * d, v * d, d) = P * [x y z 1] for points given
+ * in the source frame of the extrinsic, in metres
+ *
+ */
+class CameraProjection {
+public:
+    CameraProjection()
+        : P_(Eigen::Matrix<float, 3, 4>::Zero()), extrinsic_(Eigen::Matrix<float, 3, 4>::Identity()),
+          fx_(1.0f), fy_(1.0f), cx_(0.0f), cy_(0.0f), scale_(1.0f) {}
+
+    /**
+     * @brief Folds everything into P
+     *
+     * @param fx Focal length along x in pixels
+     * @param fy Focal length along y in pixels
+     * @param cx Principal point along x in pixels
+     * @param cy Principal point along y in pixels
+     * @param scale Scale applied to the points before the projection (1000 for mm)
+     * @param extrinsic Rigid 3x4 transform from the source frame into the camera frame
+     */
+    void set(float fx, float fy, float cx, float cy, float scale, const Eigen::Matrix<float, 3, 4>& extrinsic) {
+        Eigen::Matrix3f K;
+        K << fx, 0.0f, cx,
+             0.0f, fy, cy,
+             0.0f, 0.0f, 1.0f;
+        P_ = (scale * K) * extrinsic;
+        extrinsic_ = extrinsic;
+        fx_ = fx;
+        fy_ = fy;
+        cx_ = cx;
+        cy_ = cy;
+        scale_ = scale;
+    }
+
+    /**
+     * @brief One multiply-add pass and one reciprocal per point. The caller has to check
+     * depth > 0 before trusting u and v.
+     *
+     */
+    ProjectedPoint project(float x, float y, float z) const {
+        const float hu = P_(0, 0) * x + P_(0, 1) * y + P_(0, 2) * z + P_(0, 3);
+        const float hv = P_(1, 0) * x + P_(1, 1) * y + P_(1, 2) * z + P_(1, 3);
+        const float d = P_(2, 0) * x + P_(2, 1) * y + P_(2, 2) * z + P_(2, 3);
+        const float inv_d = 1.0f / d;
+        return ProjectedPoint{hu * inv_d, hv * inv_d, d};
+    }
+
+    /**
+     * @brief Back projects a pixel at the given depth into the camera frame, in the
+     * scaled units of the projection
+     *
+     */
+    Eigen::Vector3f backProject(float u, float v, float depth) const {
+        return Eigen::Vector3f((u - cx_) * depth / fx_, (v - cy_) * depth / fy_, depth);
+    }
+
+    /**
+     * @brief Maps a camera frame point in the scaled units back into the source frame,
+     * in metres. Assumes a rigid extrinsic.
+     *
+     */
+    Eigen::Vector3f toSource(const Eigen::Vector3f& camera_point) const {
+        return extrinsic_.leftCols<3>().transpose() * (camera_point / scale_ - extrinsic_.col(3));
+    }
+
+    const Eigen::Matrix<float, 3, 4>& matrix() const { return P_; }
+    float fx() const { return fx_; }
+    float fy() const { return fy_; }
+    float cx() const { return cx_; }
+    float cy() const { return cy_; }
+
+private:
+    Eigen::Matrix<float, 3, 4> P_;
+    Eigen::Matrix<float, 3, 4> extrinsic_;
+    float fx_;
+    float fy_;
+    float cx_;
+    float cy_;
+    float scale_;
+};
+
+}  // namespace tflite_prop_detection
+
+#endif  // TFLITE_PROP_DETECTION_CAMERA_PROJECTION_H
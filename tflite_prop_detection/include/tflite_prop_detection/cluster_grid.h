@@ -0,0 +1,367 @@
+/**
+ * @file cluster_grid.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Euclidean clustering of the gated points of one box on a flat hashed voxel
+ * grid. The grid is cleared by bumping a generation counter and only grows, so frame
+ * after frame it runs without allocating, unlike a PCL KdTree rebuilt per cloud. The
+ * cluster at the box center or the most compact one stands in for the target, the
+ * background and neighbouring drones inside the frustum fall into other clusters.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef TFLITE_PROP_DETECTION_CLUSTER_GRID_H
+#define TFLITE_PROP_DETECTION_CLUSTER_GRID_H
+
+#include <tflite_prop_detection/bbox_gate.h>
+#include <tflite_prop_detection/camera_projection.h>
+#include <Eigen/Core>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace tflite_prop_detection {
+
+/**
+ * @brief Which cluster of a box is taken for the target
+ *
+ */
+enum class ClusterSelection {
+    kNone,     // no clustering, every gated point
+    kCenter,   // the cluster with the most points in the central half of the box
+    kCompact,  // the cluster with the smallest RMS radius
+};
+
+inline const char* clusterSelectionName(ClusterSelection selection) {
+    switch (selection) {
+        case ClusterSelection::kCenter: return "center";
+        case ClusterSelection::kCompact: return "compact";
+        default: return "none";
+    }
+}
+
+/**
+ * @brief Parses none, center or compact
+ *
+ * @return false if the name is unknown, selection is left untouched
+ */
+inline bool parseClusterSelection(const std::string& name, ClusterSelection& selection) {
+    if (name == "none") {
+        selection = ClusterSelection::kNone;
+    } else if (name == "center") {
+        selection = ClusterSelection::kCenter;
+    } else if (name == "compact") {
+        selection = ClusterSelection::kCompact;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Size, centroid and RMS radius of one cluster, in mm
+ *
+ */
+struct PointCluster {
+    size_t count = 0;
+    Eigen::Vector3f centroid = Eigen::Vector3f::Zero();
+    float radius = 0.0f;
+};
+
+class ClusterGrid {
+public:
+    /**
+     * @param max_points Points per call the buffers are sized for up front
+     */
+    explicit ClusterGrid(size_t max_points = 0) { reserve(max_points); }
+
+    /**
+     * @brief Sizes the buffers for max_points, the only place that allocates
+     *
+     */
+    void reserve(size_t max_points) {
+        if (next_.size() < max_points) {
+            next_.resize(max_points);
+            labels_.resize(max_points);
+            point_cells_.resize(max_points);
+            // 27 neighbours of every occupied cell at worst
+            neighbours_.reserve(27 * max_points);
+            stack_.reserve(max_points);
+            clusters_.reserve(max_points);
+            votes_.reserve(max_points);
+        }
+        // At most half full keeps the linear probes short
+        size_t cells = 64;
+        while (cells < 2 * max_points) {
+            cells *= 2;
+        }
+        if (cells > cells_.size()) {
+            cells_.assign(cells, Cell());
+            generation_ = 0;
+        }
+    }
+
+    /**
+     * @brief Moves the generation counter to generation, the next cluster() call runs at
+     * the one after. It must not move down, stale cells could look current again. Lets a
+     * test reach the wrap of the counter, which takes 2^32 calls otherwise.
+     *
+     */
+    void startGeneration(uint32_t generation) { generation_ = generation; }
+
+    /**
+     * @brief Splits the points into clusters in which every point lies within tolerance
+     * of another point of the same cluster
+     *
+     * @param tolerance Largest gap inside a cluster, in mm
+     * @return size_t Number of clusters, see label() and cluster()
+     */
+    size_t cluster(const Eigen::Vector3f* points, size_t n, float tolerance) {
+        reserve(n);
+        point_count_ = n;
+        clusters_.clear();
+        if (++generation_ == 0) {
+            // The counter wrapped, stale cells could look current again
+            for (Cell& cell : cells_) {
+                cell.generation = 0;
+            }
+            generation_ = 1;
+        }
+        const float inv_tolerance = 1.0f / tolerance;
+        const float tolerance_sq = tolerance * tolerance;
+        neighbours_.clear();
+        for (size_t i = 0; i < n; ++i) {
+            const uint32_t slot = insertCell(cellOf(points[i], inv_tolerance));
+            Cell& cell = cells_[slot];
+            next_[i] = cell.head;
+            cell.head = static_cast<int32_t>(i);
+            point_cells_[i] = slot;
+            labels_[i] = -1;
+        }
+        for (size_t seed = 0; seed < n; ++seed) {
+            if (labels_[seed] >= 0) {
+                continue;
+            }
+            const int32_t label = static_cast<int32_t>(clusters_.size());
+            Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+            double sum_sq = 0.0;
+            size_t count = 0;
+            labels_[seed] = label;
+            stack_.clear();
+            stack_.push_back(static_cast<int32_t>(seed));
+            while (!stack_.empty()) {
+                const int32_t i = stack_.back();
+                stack_.pop_back();
+                const Eigen::Vector3f& p = points[i];
+                sum += p.cast<double>();
+                sum_sq += p.cast<double>().squaredNorm();
+                ++count;
+                Cell& home = cells_[point_cells_[i]];
+                if (home.neighbours_begin < 0) {
+                    findNeighbours(home);
+                }
+                for (int32_t k = home.neighbours_begin; k < home.neighbours_end; ++k) {
+                    // Labelled points leave their cell, so the dense core of a cluster
+                    // is walked once instead of once per neighbour
+                    int32_t* link = &cells_[neighbours_[k]].head;
+                    while (*link >= 0) {
+                        const int32_t j = *link;
+                        if (labels_[j] >= 0) {
+                            *link = next_[j];
+                        } else if ((points[j] - p).squaredNorm() <= tolerance_sq) {
+                            labels_[j] = label;
+                            stack_.push_back(j);
+                            *link = next_[j];
+                        } else {
+                            link = &next_[j];
+                        }
+                    }
+                }
+            }
+            PointCluster cluster;
+            cluster.count = count;
+            const Eigen::Vector3d mean = sum / static_cast<double>(count);
+            cluster.centroid = mean.cast<float>();
+            cluster.radius =
+                static_cast<float>(std::sqrt(std::max(sum_sq / static_cast<double>(count) - mean.squaredNorm(), 0.0)));
+            clusters_.push_back(cluster);
+        }
+        return clusters_.size();
+    }
+
+    /**
+     * @brief Cluster of the i-th point of the last call
+     *
+     */
+    int32_t label(size_t i) const { return labels_[i]; }
+
+    const PointCluster& cluster(size_t c) const { return clusters_[c]; }
+
+    size_t clusters() const { return clusters_.size(); }
+
+    /**
+     * @brief The cluster of the last call that stands for the target of box
+     *
+     * Center counts the points of every cluster that project into the central half of
+     * the box. The target covers the middle of its box, while the background centroid
+     * lands there too whenever it fills the box evenly, so the centroid alone does not
+     * tell them apart. Ties go to the nearer cluster.
+     *
+     * @param points The points of the last call
+     * @param min_points Clusters with fewer points are never picked
+     * @return int Index of the cluster, -1 if none has min_points
+     */
+    int select(ClusterSelection selection, const Eigen::Vector3f* points, const CameraProjection& projection,
+               const BoundingBox& box, size_t min_points) {
+        if (selection == ClusterSelection::kCenter) {
+            votes_.assign(clusters_.size(), 0);
+            const float u0 = 0.5f * (box.x_min + box.x_max);
+            const float v0 = 0.5f * (box.y_min + box.y_max);
+            const float half_u = 0.25f * (box.x_max - box.x_min);
+            const float half_v = 0.25f * (box.y_max - box.y_min);
+            const size_t n = point_count_;
+            for (size_t i = 0; i < n; ++i) {
+                const Eigen::Vector3f& p = points[i];
+                if (!(p.z() > 0.0f)) {
+                    continue;
+                }
+                const float inv_z = 1.0f / p.z();
+                const float u = projection.fx() * p.x() * inv_z + projection.cx();
+                const float v = projection.fy() * p.y() * inv_z + projection.cy();
+                if (std::abs(u - u0) <= half_u && std::abs(v - v0) <= half_v) {
+                    ++votes_[labels_[i]];
+                }
+            }
+        }
+        int best = -1;
+        for (size_t c = 0; c < clusters_.size(); ++c) {
+            const PointCluster& cluster = clusters_[c];
+            if (cluster.count < min_points) {
+                continue;
+            }
+            if (best < 0) {
+                best = static_cast<int>(c);
+                continue;
+            }
+            const PointCluster& current = clusters_[best];
+            bool better;
+            if (selection == ClusterSelection::kCompact) {
+                better = cluster.radius < current.radius;
+            } else if (votes_[c] != votes_[best]) {
+                better = votes_[c] > votes_[best];
+            } else {
+                better = cluster.centroid.z() < current.centroid.z();
+            }
+            if (better) {
+                best = static_cast<int>(c);
+            }
+        }
+        return best;
+    }
+
+private:
+
+    struct Key {
+        int32_t x, y, z;
+    };
+
+    struct Cell {
+        uint32_t generation = 0;
+        Key key{0, 0, 0};
+        int32_t head = -1;
+        // Occupied neighbours in neighbours_, looked up once for all points of the cell
+        int32_t neighbours_begin = -1;
+        int32_t neighbours_end = -1;
+    };
+
+    static Key cellOf(const Eigen::Vector3f& p, float inv_tolerance) {
+        return Key{static_cast<int32_t>(std::floor(p.x() * inv_tolerance)),
+                   static_cast<int32_t>(std::floor(p.y() * inv_tolerance)),
+                   static_cast<int32_t>(std::floor(p.z() * inv_tolerance))};
+    }
+
+    size_t slotOf(const Key& key) const {
+        const uint32_t h = static_cast<uint32_t>(key.x) * 73856093u ^ static_cast<uint32_t>(key.y) * 19349663u ^
+                           static_cast<uint32_t>(key.z) * 83492791u;
+        return h & (cells_.size() - 1);
+    }
+
+    static bool sameKey(const Key& a, const Key& b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+
+    uint32_t insertCell(const Key& key) {
+        size_t slot = slotOf(key);
+        for (;;) {
+            Cell& cell = cells_[slot];
+            if (cell.generation != generation_) {
+                cell.generation = generation_;
+                cell.key = key;
+                cell.head = -1;
+                cell.neighbours_begin = -1;
+                cell.neighbours_end = -1;
+                return static_cast<uint32_t>(slot);
+            }
+            if (sameKey(cell.key, key)) {
+                return static_cast<uint32_t>(slot);
+            }
+            slot = (slot + 1) & (cells_.size() - 1);
+        }
+    }
+
+    /**
+     * @return int32_t Slot of the cell, -1 if it holds no point
+     */
+    int32_t findCell(const Key& key) const {
+        size_t slot = slotOf(key);
+        for (;;) {
+            const Cell& cell = cells_[slot];
+            if (cell.generation != generation_) {
+                return -1;
+            }
+            if (sameKey(cell.key, key)) {
+                return static_cast<int32_t>(slot);
+            }
+            slot = (slot + 1) & (cells_.size() - 1);
+        }
+    }
+
+    void findNeighbours(Cell& cell) {
+        cell.neighbours_begin = static_cast<int32_t>(neighbours_.size());
+        for (int dx = -1; dx <= 1; ++dx) {
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dz = -1; dz <= 1; ++dz) {
+                    const int32_t slot = findCell(Key{cell.key.x + dx, cell.key.y + dy, cell.key.z + dz});
+                    if (slot >= 0) {
+                        neighbours_.push_back(slot);
+                    }
+                }
+            }
+        }
+        cell.neighbours_end = static_cast<int32_t>(neighbours_.size());
+    }
+
+    // Open addressing table of the occupied cells, a cell of an older generation is empty
+    std::vector<Cell> cells_;
+    uint32_t generation_ = 0;
+    // Occupied neighbours of the cells expanded so far, 27 per cell at most
+    std::vector<int32_t> neighbours_;
+    // Per point: next point of the same cell, slot of its cell and cluster label
+    std::vector<int32_t> next_;
+    std::vector<uint32_t> point_cells_;
+    std::vector<int32_t> labels_;
+    std::vector<int32_t> stack_;
+    std::vector<PointCluster> clusters_;
+    // Points of every cluster in the central half of the box, for select()
+    std::vector<uint32_t> votes_;
+    size_t point_count_ = 0;
+};
+
+}  // namespace tflite_prop_detection
+
+#endif  // TFLITE_PROP_DETECTION_CLUSTER_GRID_H
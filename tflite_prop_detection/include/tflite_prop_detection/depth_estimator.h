@@ -0,0 +1,173 @@
+/**
+ * @file depth_estimator.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Fixed size depth histogram filled by the gating kernels and the robust
+ * centroid estimators that read it. The histogram keeps per bin sums of x, y and z,
+ * so every estimator is a walk over the bins without a second pass over the points.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef TFLITE_PROP_DETECTION_DEPTH_ESTIMATOR_H
+#define TFLITE_PROP_DETECTION_DEPTH_ESTIMATOR_H
+
+#include <Eigen/Core>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace tflite_prop_detection {
+
+/**
+ * @brief Number of depth bins, 25 mm wide over the default 0.1 m to 3.3 m range
+ *
+ */
+constexpr int kDepthBins = 128;
+
+/**
+ * @brief Depth histogram of the gated points in mm. Points outside the range land in
+ * the first or last bin.
+ *
+ */
+struct DepthHistogram {
+    float z_min = 100.0f;
+    float bin_width = 25.0f;
+    float inv_bin_width = 1.0f / 25.0f;
+    std::array<uint32_t, kDepthBins> count;
+    std::array<float, kDepthBins> sx;
+    std::array<float, kDepthBins> sy;
+    std::array<float, kDepthBins> sz;
+
+    DepthHistogram() { clear(); }
+
+    void configure(float depth_min, float depth_max) {
+        z_min = depth_min;
+        bin_width = std::max(depth_max - depth_min, 1.0f) / kDepthBins;
+        inv_bin_width = 1.0f / bin_width;
+    }
+
+    void clear() {
+        count.fill(0);
+        sx.fill(0.0f);
+        sy.fill(0.0f);
+        sz.fill(0.0f);
+    }
+
+    void add(float x, float y, float z) {
+        const int bin = std::min(std::max(static_cast<int>((z - z_min) * inv_bin_width), 0), kDepthBins - 1);
+        ++count[bin];
+        sx[bin] += x;
+        sy[bin] += y;
+        sz[bin] += z;
+    }
+};
+
+/**
+ * @brief Estimators for the position of the target from the gated points
+ *
+ */
+enum class DepthEstimator {
+    kMean,         // arithmetic mean of every gated point
+    kMode,         // mean of the points around the most populated depth
+    kMedian,       // median depth, x and y of the points at that depth
+    kTrimmedMean,  // mean after dropping the nearest and farthest points
+};
+
+constexpr int kDepthEstimatorCount = 4;
+
+inline const char* depthEstimatorName(DepthEstimator estimator) {
+    switch (estimator) {
+        case DepthEstimator::kMode: return "mode";
+        case DepthEstimator::kMedian: return "median";
+        case DepthEstimator::kTrimmedMean: return "trimmed_mean";
+        default: return "mean";
+    }
+}
+
+inline bool parseDepthEstimator(const std::string& name, DepthEstimator& estimator) {
+    for (int i = 0; i < kDepthEstimatorCount; ++i) {
+        if (name == depthEstimatorName(static_cast<DepthEstimator>(i))) {
+            estimator = static_cast<DepthEstimator>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Mean of the three neighbouring bins with the most points. The window keeps a
+ * surface that straddles a bin edge in one piece.
+ *
+ */
+inline Eigen::Vector3f estimateMode(const DepthHistogram& histogram) {
+    int best = 0;
+    uint32_t best_count = 0;
+    for (int bin = 0; bin < kDepthBins; ++bin) {
+        const uint32_t window = histogram.count[bin] + (bin > 0 ? histogram.count[bin - 1] : 0) +
+                                (bin + 1 < kDepthBins ? histogram.count[bin + 1] : 0);
+        if (window > best_count) {
+            best_count = window;
+            best = bin;
+        }
+    }
+    Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+    for (int bin = std::max(best - 1, 0); bin <= std::min(best + 1, kDepthBins - 1); ++bin) {
+        sum += Eigen::Vector3f(histogram.sx[bin], histogram.sy[bin], histogram.sz[bin]);
+    }
+    return sum / static_cast<float>(std::max<uint32_t>(best_count, 1));
+}
+
+/**
+ * @brief Median depth interpolated inside its bin. x and y are the mean of that bin,
+ * rescaled from the bin mean depth to the median depth along the viewing ray.
+ *
+ */
+inline Eigen::Vector3f estimateMedian(const DepthHistogram& histogram, size_t total) {
+    const float half = 0.5f * static_cast<float>(total);
+    float below = 0.0f;
+    for (int bin = 0; bin < kDepthBins; ++bin) {
+        const float n = static_cast<float>(histogram.count[bin]);
+        if (n > 0.0f && below + n >= half) {
+            const float depth = histogram.z_min + (bin + (half - below) / n) * histogram.bin_width;
+            const float mean_z = histogram.sz[bin] / n;
+            const float scale = mean_z > 0.0f ? depth / mean_z : 1.0f;
+            return Eigen::Vector3f(histogram.sx[bin] / n * scale, histogram.sy[bin] / n * scale, depth);
+        }
+        below += n;
+    }
+    return Eigen::Vector3f::Zero();
+}
+
+/**
+ * @brief Mean of the points between the trim and 1 - trim depth quantiles. Bins that
+ * straddle a quantile contribute the matching fraction of their sums.
+ *
+ */
+inline Eigen::Vector3f estimateTrimmedMean(const DepthHistogram& histogram, size_t total, float trim) {
+    const float lo = trim * static_cast<float>(total);
+    const float hi = (1.0f - trim) * static_cast<float>(total);
+    Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+    float weight = 0.0f;
+    float below = 0.0f;
+    for (int bin = 0; bin < kDepthBins && below < hi; ++bin) {
+        const float n = static_cast<float>(histogram.count[bin]);
+        const float kept = std::min(below + n, hi) - std::max(below, lo);
+        if (n > 0.0f && kept > 0.0f) {
+            const float fraction = kept / n;
+            sum += fraction * Eigen::Vector3f(histogram.sx[bin], histogram.sy[bin], histogram.sz[bin]);
+            weight += kept;
+        }
+        below += n;
+    }
+    return weight > 0.0f ? Eigen::Vector3f(sum / weight) : Eigen::Vector3f::Zero();
+}
+
+}  // namespace tflite_prop_detection
+
+#endif  // TFLITE_PROP_DETECTION_DEPTH_ESTIMATOR_H
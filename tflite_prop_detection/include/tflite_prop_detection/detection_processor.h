@@ -0,0 +1,403 @@
+/**
+ * @file detection_processor.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief The per message work of the detection stage without the ROS transport: pairs
+ * the detections with a cloud, gates the cloud against their boxes and estimates the
+ * centroids. Shared by TFLitePropDetectionNode and the offline pipeline.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef TFLITE_PROP_DETECTION_DETECTION_PROCESSOR_H
+#define TFLITE_PROP_DETECTION_DETECTION_PROCESSOR_H
+
+#include <nav_msgs/Odometry.h>
+#include <ros/console.h>
+#include <ros/time.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <voxl_mpa_to_ros/AiDetection.h>
+#include <tflite_prop_detection/ObjectCentroidArray.h>
+#include <tflite_prop_detection/bbox_gate.h>
+#include <tflite_prop_detection/camera_projection.h>
+#include <tflite_prop_detection/cluster_grid.h>
+#include <tflite_prop_detection/depth_estimator.h>
+#include <tflite_prop_detection/detection_sync.h>
+#include <tflite_prop_detection/multi_bbox_gate.h>
+#include <tflite_prop_detection/organized_roi.h>
+#include <tflite_prop_detection/temporal_moments.h>
+#include <pipeline_diagnostics/latency_stats.h>
+#include <your_pointcloud_package/tof_filter_transform.h>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace tflite_prop_detection {
+
+// Longest temporal window of a track, in frames
+constexpr size_t kMaxTemporalFrames = 8;
+
+/**
+ * @brief One active detection. Detections of the same class that overlap the box of a
+ * track update that track, the others open a new one.
+ *
+ */
+struct TrackedDetection {
+    int track_id = -1;
+    uint32_t class_id = 0;
+    std::string class_name;
+    float confidence = 0.0f;
+    BoundingBox box{0.0f, 0.0f, 0.0f, 0.0f};
+    ros::Time last_seen;
+    // Accumulation reference of the gate, follows the last centroid of the track
+    Eigen::Vector3d reference = Eigen::Vector3d(0.0, 0.0, 1000.0);
+    // Moments of the last frames of the track, in the odometry frame
+    TemporalMoments<kMaxTemporalFrames> window;
+};
+
+/**
+ * @brief Parameters of the detection stage
+ *
+ */
+struct DetectionConfig {
+    // true projects the raw /tof_pc with the extrinsic folded into the camera matrix,
+    // false the transformed /rgb_pcl
+    bool project_raw_tof = false;
+    // Stamp detections with their timestamp_ns instead of the receipt time
+    bool stamp_from_detection = false;
+    // Subtracted from the receipt time, roughly the inference latency, in seconds
+    double detection_latency = 0.0;
+    // Largest accepted distance between a detection and a cloud, in seconds
+    double max_skew = 0.07;
+    // Seconds a track survives without a new detection
+    double detection_window = 0.07;
+    // Minimum IoU for a detection to update an existing track
+    double track_iou = 0.3;
+    int tile_size = 32;
+    DepthEstimator depth_estimator = DepthEstimator::kMean;
+    double depth_min_mm = 100.0;
+    double depth_max_mm = 3300.0;
+    // Fraction of the points dropped at each end by the trimmed mean
+    double trim_fraction = 0.1;
+    // Runs every estimator each frame and logs their results and timings
+    bool report_estimators = false;
+    // Raw ToF only: z gate, and the window of pixels that can reach a box
+    double z_min = 0.2;
+    double z_max = 1.5;
+    bool roi = true;
+    double roi_margin_px = 2.0;
+    double roi_depth_margin = 0.1;
+    // Every quality level of the load governor halves the ROI margin and pulls z_max in
+    // by z_step meters
+    double z_step = 0.1;
+    // Frames of gated points accumulated per track, 1 uses the current frame only
+    int temporal_frames = 1;
+    // Oldest frame kept in the window, in seconds
+    double temporal_max_age = 0.3;
+    // VIO odometry of the body, and the frame it reports
+    std::string odometry_topic = "/qvio/odometry";
+    std::string body_frame = "body";
+    // How long the last odometry sample stands in for a cloud stamped after it, in seconds
+    double pose_hold = 0.05;
+    // Cluster of the gated points kept per box, kNone keeps all of them
+    ClusterSelection cluster = ClusterSelection::kNone;
+    // Largest gap between two points of a cluster, in mm
+    double cluster_tolerance = 50.0;
+    // Smallest cluster that can be the target
+    int cluster_min_points = 5;
+    // Gated points per box the clustering buffers hold, boxes with more keep every point
+    int cluster_max_points = 8192;
+
+    /**
+     * @brief Reads the parameters through params.param(name, value, default), from a
+     * private ros::NodeHandle or anything with the same interface
+     *
+     */
+    template <typename Params>
+    void load(const Params& params) {
+        // "hires" projects the transformed cloud on /rgb_pcl, "tof" projects the raw /tof_pc
+        // with the world->hires extrinsic folded into the camera matrix, which makes the
+        // separate pointcloud_transformer node unnecessary
+        std::string projection_mode;
+        params.param("projection_mode", projection_mode, std::string("hires"));
+        project_raw_tof = projection_mode == "tof";
+        if (!project_raw_tof && projection_mode != "hires") {
+            ROS_WARN("Unknown projection_mode '%s', using hires", projection_mode.c_str());
+        }
+        // Every cloud is paired with the detections within max_skew seconds of its stamp,
+        // the default matches the old single bbox staleness check. Detections are stamped on
+        // receipt minus detection_latency, or with their own timestamp_ns when that clock
+        // matches the cloud stamps.
+        std::string detection_stamp_source;
+        params.param("detection_stamp_source", detection_stamp_source, std::string("receipt"));
+        params.param("detection_latency", detection_latency, 0.0);
+        params.param("max_skew", max_skew, 0.07);
+        stamp_from_detection = detection_stamp_source == "timestamp_ns";
+        if (!stamp_from_detection && detection_stamp_source != "receipt") {
+            ROS_WARN("Unknown detection_stamp_source '%s', using receipt", detection_stamp_source.c_str());
+        }
+        // A track keeps its id and reference for detection_window seconds without a pairing
+        params.param("detection_window", detection_window, 0.07);
+        params.param("track_iou", track_iou, 0.3);
+        params.param("tile_size", tile_size, 32);
+        // mean keeps the plain centroid, mode, median and trimmed_mean read a depth histogram
+        // of the gated points and ignore the background behind the props
+        std::string estimator;
+        params.param("depth_estimator", estimator, std::string("mean"));
+        depth_estimator = DepthEstimator::kMean;
+        if (!parseDepthEstimator(estimator, depth_estimator)) {
+            ROS_WARN("Unknown depth_estimator '%s', using mean", estimator.c_str());
+        }
+        params.param("depth_min_mm", depth_min_mm, 100.0);
+        params.param("depth_max_mm", depth_max_mm, 3300.0);
+        params.param("trim_fraction", trim_fraction, 0.1);
+        params.param("report_estimators", report_estimators, false);
+        trim_fraction = std::min(std::max(trim_fraction, 0.0), 0.49);
+        if (project_raw_tof) {
+            params.param("z_min", z_min, 0.2);
+            params.param("z_max", z_max, 1.5);
+            // A positive z_min is what drops the all zero points, see TofGate
+            z_min = std::max(z_min, 0.01);
+            // The gated ToF depth and the hires depth differ by the small extrinsic, the
+            // depth margin covers that
+            params.param("roi", roi, true);
+            params.param("roi_margin_px", roi_margin_px, 2.0);
+            params.param("roi_depth_margin", roi_depth_margin, 0.1);
+            params.param("governor_z_step", z_step, 0.1);
+            z_step = std::max(z_step, 0.0);
+        }
+        // Far targets only get a few points per frame, the window sums them over the last
+        // frames in the odometry frame so the drone motion does not smear them
+        params.param("temporal_frames", temporal_frames, 1);
+        params.param("temporal_max_age", temporal_max_age, 0.3);
+        params.param("odometry_topic", odometry_topic, std::string("/qvio/odometry"));
+        params.param("body_frame", body_frame, std::string("body"));
+        params.param("pose_hold", pose_hold, 0.05);
+        if (temporal_frames > static_cast<int>(kMaxTemporalFrames)) {
+            ROS_WARN("temporal_frames %d is more than %zu, using %zu", temporal_frames, kMaxTemporalFrames,
+                     kMaxTemporalFrames);
+        }
+        temporal_frames = std::min(std::max(temporal_frames, 1), static_cast<int>(kMaxTemporalFrames));
+        // The frustum of a box also holds the background and neighbouring drones, center
+        // keeps the cluster in the middle of the box and compact the tightest one
+        std::string cluster_name;
+        params.param("cluster", cluster_name, std::string("none"));
+        cluster = ClusterSelection::kNone;
+        if (!parseClusterSelection(cluster_name, cluster)) {
+            ROS_WARN("Unknown cluster '%s', using none", cluster_name.c_str());
+        }
+        params.param("cluster_tolerance", cluster_tolerance, 50.0);
+        params.param("cluster_min_points", cluster_min_points, 5);
+        params.param("cluster_max_points", cluster_max_points, 8192);
+        cluster_tolerance = std::max(cluster_tolerance, 1.0);
+        cluster_min_points = std::max(cluster_min_points, 1);
+        cluster_max_points = std::max(cluster_max_points, 1);
+    }
+};
+
+class DetectionProcessor {
+public:
+    // Stages recorded into the StageStats given to the constructor, from index 0. The
+    // per estimator timings follow kStageEstimators.
+    enum Stage : size_t {
+        kStageAssociate,
+        kStageLayout,
+        kStageProjectGate,
+        kStageEstimate,
+        kStageRoi,
+        kStageCluster,
+        kStageTemporal,
+        kStageEstimators,
+        kStageCount = kStageEstimators + kDepthEstimatorCount,
+    };
+
+    static std::vector<std::string> stageNames();
+
+    /**
+     * @param stats Histograms of the stages, the first kStageCount are used
+     */
+    DetectionProcessor(const DetectionConfig& config, pipeline_diagnostics::StageStats& stats);
+
+    const DetectionConfig& config() const { return config_; }
+
+    /**
+     * @brief Topic of the cloud the detections are located in
+     *
+     */
+    const char* cloudTopic() const { return config_.project_raw_tof ? "/tof_pc" : "/rgb_pcl"; }
+
+    /**
+     * @brief Whether the tracks accumulate their points over several frames, which needs
+     * addPose and setCameraMount
+     *
+     */
+    bool temporal() const { return config_.temporal_frames > 1; }
+
+    /**
+     * @brief Converts a detection received at receipt, stamped as configured
+     *
+     */
+    TimedDetection toTimedDetection(const voxl_mpa_to_ros::AiDetection& msg, const ros::Time& receipt) const;
+
+    /**
+     * @brief Queues a detection for the next clouds. Lock free, may run on another thread
+     * than the cloud calls, but only one thread at a time.
+     *
+     */
+    void addDetection(const TimedDetection& detection) { detection_ring_.push(detection); }
+
+    static StampedPose toStampedPose(const nav_msgs::Odometry& msg);
+
+    /**
+     * @brief Queues an odometry sample for the temporal window, with the same threading
+     * rules as addDetection
+     *
+     */
+    void addPose(const StampedPose& pose) { pose_ring_.push(pose); }
+
+    /**
+     * @brief Sets the transform from hires into the body frame of the odometry, needed
+     * before locateObjects when temporal() is true
+     *
+     */
+    void setCameraMount(const Eigen::Matrix<float, 3, 4>& hires_to_body);
+
+    /**
+     * @brief Pairs the queued detections with a cloud stamped stamp and updates the
+     * tracks
+     *
+     * @return size_t Number of tracks the cloud is gated against, nothing is left to do
+     * for the cloud when it is 0
+     */
+    size_t pairDetections(const ros::Time& stamp);
+
+    /**
+     * @brief Sets the extrinsic from the frame of the raw ToF cloud into hires, needed
+     * before locateObjects when the raw cloud is projected
+     *
+     */
+    void setExtrinsic(const Eigen::Matrix<float, 3, 4>& source_to_hires);
+
+    /**
+     * @brief Trades quality for time on the raw ToF cloud, see DetectionConfig::z_step.
+     * Level 0 is the configured quality, the hires cloud has no knob here.
+     *
+     */
+    void setQualityLevel(int level);
+
+    /**
+     * @brief Gates the cloud against the tracks paired by the last pairDetections and
+     * writes the centroid of every track with points into centroids
+     *
+     * @return int Index in centroids.objects of the most confident object, -1 when no
+     * track has points or the cloud has no float32 x, y, z fields
+     */
+    int locateObjects(const sensor_msgs::PointCloud2& msg, ObjectCentroidArray& centroids);
+
+private:
+    /**
+     * @brief Window of the organized ToF cloud that covers the first n_boxes boxes,
+     * fitting the sensor model first when the cloud size changed
+     *
+     * @return false if the whole cloud has to be scanned
+     */
+    bool roiWindow(const uint8_t* data, const your_pointcloud_package::CloudLayout& layout, size_t n_boxes,
+                   PixelWindow& window);
+
+    /**
+     * @brief Drops the tracks that have not been paired with a cloud within the
+     * detection window
+     *
+     */
+    void expireTracks(const ros::Time& stamp);
+
+    /**
+     * @brief Matches a detection to one of the tracks from first onwards, by class and
+     * IoU, or opens a new track. When all slots are taken the least recently seen track
+     * is replaced.
+     *
+     * @return size_t Slot of the track
+     */
+    size_t updateTrack(const TimedDetection& detection, const ros::Time& stamp, size_t first);
+
+    /**
+     * @brief Position of the target of the i-th gated box with the given estimator, from
+     * the moments and the depth histogram of the last frame
+     *
+     */
+    Eigen::Vector3f estimateCentroid(DepthEstimator estimator, size_t i) const;
+
+    /**
+     * @brief Pose of hires in the odometry frame at stamp, translation in mm
+     *
+     * @return false without odometry around the stamp or without the camera mount
+     */
+    bool cameraPose(const ros::Time& stamp, Eigen::Isometry3d& camera_to_odom);
+
+    /**
+     * @brief Narrows the moments and the histogram of the i-th gated box down to the
+     * cluster of its points picked by config_.cluster. The box keeps every point when its
+     * buffer overflowed or no cluster is large enough.
+     *
+     */
+    void clusterBox(size_t i, bool fill_histograms);
+
+    DetectionConfig config_;
+    pipeline_diagnostics::StageStats& stats_;
+    // Written by addDetection, read by pairDetections
+    static constexpr size_t kDetectionRingSize = 64;
+    SpscRing<TimedDetection, kDetectionRingSize> detection_ring_;
+    // Copies of the ring and the detections paired with the current cloud
+    std::array<TimedDetection, kDetectionRingSize> recent_detections_;
+    std::array<TimedDetection, kMaxDetections> paired_detections_;
+    // Written by addPose, read by cameraPose, and the copy of the ring
+    static constexpr size_t kPoseRingSize = 64;
+    SpscRing<StampedPose, kPoseRingSize> pose_ring_;
+    std::array<StampedPose, kPoseRingSize> recent_poses_;
+    // hires in the body frame, translation in mm
+    Eigen::Isometry3d camera_to_body_;
+    bool has_camera_mount_;
+    // Tracked detections, the first n_tracks_ slots are in use, the first n_gated_ of
+    // them are paired with the current cloud
+    std::array<TrackedDetection, kMaxDetections> tracks_;
+    size_t n_tracks_;
+    size_t n_gated_;
+    int next_track_id_;
+    // Boxes and moments of the active tracks in gating order
+    std::array<BoundingBox, kMaxDetections> boxes_;
+    std::array<GateMoments, kMaxDetections> moments_;
+    // Moments over the temporal window of every gated track
+    std::array<GateMoments, kMaxDetections> window_moments_;
+    std::array<DepthHistogram, kMaxDetections> histograms_;
+    // Objects trimmed off an output message, reused when the next one grows
+    std::vector<ObjectCentroid> spare_objects_;
+    // Gated points of every box and the grid that clusters them, only with config_.cluster
+    std::array<GatedPoints, kMaxDetections> gated_points_;
+    ClusterGrid cluster_grid_;
+    TiledBoxIndex box_index_;
+    Eigen::Matrix<float, 3, 4> K_pcl_;
+    int image_width_;
+    int image_height_;
+    // extrinsic, mm scaling and intrinsics folded into one 3x4 matrix
+    CameraProjection projection_;
+    your_pointcloud_package::TofGate tof_gate_;
+    // Only the pixels of the organized /tof_pc that can reach a box are gated
+    bool use_roi_;
+    OrganizedPinhole sensor_model_;
+    // Extra ToF pixels around every window
+    float roi_margin_px_;
+    // hires depth range covered by the windows, the ToF gate widened by roi_depth_margin, in mm
+    float roi_near_mm_;
+    float roi_far_mm_;
+};
+
+}  // namespace tflite_prop_detection
+
+#endif  // TFLITE_PROP_DETECTION_DETECTION_PROCESSOR_H
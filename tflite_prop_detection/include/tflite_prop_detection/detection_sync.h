@@ -0,0 +1,198 @@
+/**
+ * @file detection_sync.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Time synchronisation of the detections with the ToF frames. The detection
+ * callback pushes every detection into a lock-free single producer, single consumer
+ * ring, the cloud callback reads the recent ones and pairs each object with the box
+ * closest to the cloud stamp, interpolated when the frame falls between two detections.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef TFLITE_PROP_DETECTION_DETECTION_SYNC_H
+#define TFLITE_PROP_DETECTION_DETECTION_SYNC_H
+
+#include <tflite_prop_detection/bbox_gate.h>
+#include <tflite_prop_detection/multi_bbox_gate.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <type_traits>
+
+namespace tflite_prop_detection {
+
+/**
+ * @brief One detection as stored in the ring, trivially copyable
+ *
+ */
+struct TimedDetection {
+    int64_t stamp_ns;
+    uint32_t class_id;
+    float confidence;
+    BoundingBox box;
+    char class_name[32];
+};
+
+/**
+ * @brief Fixed capacity ring that never blocks the producer: a push overwrites the oldest
+ * entry. Every slot carries a sequence counter (odd while it is written) so the consumer
+ * can copy entries out without a lock and retry the rare copy that raced with a push.
+ * push() must only be called from one thread at a time and snapshot() from one thread
+ * at a time, which is what a ROS subscription guarantees for its callback even on a
+ * multi-threaded spinner.
+ *
+ */
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "Ring entries are copied racily and must be trivially copyable");
+
+public:
+    void push(const T& value) {
+        const uint64_t head = head_.load(std::memory_order_relaxed);
+        Slot& slot = slots_[head & (Capacity - 1)];
+        const uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+        slot.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.value = value;
+        slot.seq.store(seq + 2, std::memory_order_release);
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Copies up to max_count of the newest entries into out, newest first
+     *
+     * @return size_t Number of entries copied
+     */
+    size_t snapshot(T* out, size_t max_count) const {
+        const uint64_t head = head_.load(std::memory_order_acquire);
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(std::min<uint64_t>(head, Capacity), max_count));
+        for (size_t i = 0; i < n; ++i) {
+            const Slot& slot = slots_[(head - 1 - i) & (Capacity - 1)];
+            for (;;) {
+                const uint32_t before = slot.seq.load(std::memory_order_acquire);
+                if (before & 1u) {
+                    continue;
+                }
+                out[i] = slot.value;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.seq.load(std::memory_order_relaxed) == before) {
+                    break;
+                }
+            }
+        }
+        return n;
+    }
+
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint32_t> seq{0};
+        T value;
+    };
+
+    alignas(64) std::atomic<uint64_t> head_{0};
+    std::array<Slot, Capacity> slots_;
+};
+
+/**
+ * @brief Picks the box of every object seen within max_skew_ns of stamp_ns. Detections
+ * of the same class whose boxes overlap by at least min_iou are one object. The closest
+ * detection wins and, when the closest detection on the other side of the frame is
+ * also in the window, the box is linearly interpolated to the frame stamp.
+ *
+ * @param recent Recent detections in any order
+ * @param n Number of recent detections, at most the ring capacity
+ * @param stamp_ns Stamp of the cloud
+ * @param max_skew_ns Largest accepted distance between a detection and the cloud
+ * @param min_iou Overlap above which two detections are the same object
+ * @param out One detection per object, stamped with stamp_ns
+ * @param max_out Capacity of out, at most kMaxDetections objects are returned
+ * @return size_t Number of objects written to out
+ */
+template <size_t MaxRecent>
+size_t associateDetections(const TimedDetection* recent, size_t n, int64_t stamp_ns, int64_t max_skew_ns,
+                           float min_iou, TimedDetection* out, size_t max_out) {
+    // Candidates ordered by their distance to the frame, insertion sort on a few dozen
+    std::array<size_t, MaxRecent> order;
+    size_t n_candidates = 0;
+    for (size_t i = 0; i < std::min(n, MaxRecent); ++i) {
+        const int64_t skew = std::llabs(recent[i].stamp_ns - stamp_ns);
+        if (!(recent[i].confidence > 0.0f) || skew > max_skew_ns) {
+            continue;
+        }
+        size_t pos = n_candidates++;
+        while (pos > 0 && std::llabs(recent[order[pos - 1]].stamp_ns - stamp_ns) > skew) {
+            order[pos] = order[pos - 1];
+            --pos;
+        }
+        order[pos] = i;
+    }
+    struct Pairing {
+        size_t nearest;
+        size_t partner;
+        bool has_partner;
+    };
+    std::array<Pairing, kMaxDetections> pairings;
+    size_t n_pairings = 0;
+    max_out = std::min(max_out, kMaxDetections);
+    for (size_t c = 0; c < n_candidates; ++c) {
+        const TimedDetection& candidate = recent[order[c]];
+        size_t match = n_pairings;
+        float best_iou = min_iou;
+        for (size_t p = 0; p < n_pairings; ++p) {
+            const TimedDetection& nearest = recent[pairings[p].nearest];
+            if (nearest.class_id != candidate.class_id) {
+                continue;
+            }
+            const float iou = intersectionOverUnion(nearest.box, candidate.box);
+            if (iou >= best_iou) {
+                best_iou = iou;
+                match = p;
+            }
+        }
+        if (match == n_pairings) {
+            if (n_pairings < max_out) {
+                pairings[n_pairings++] = Pairing{order[c], 0, false};
+            }
+            continue;
+        }
+        Pairing& pairing = pairings[match];
+        const bool nearest_before = recent[pairing.nearest].stamp_ns <= stamp_ns;
+        const bool candidate_before = candidate.stamp_ns <= stamp_ns;
+        // Candidates come closest first, so the first one across the frame is the partner
+        if (!pairing.has_partner && nearest_before != candidate_before) {
+            pairing.partner = order[c];
+            pairing.has_partner = true;
+        }
+    }
+    for (size_t p = 0; p < n_pairings; ++p) {
+        const TimedDetection& nearest = recent[pairings[p].nearest];
+        out[p] = nearest;
+        out[p].stamp_ns = stamp_ns;
+        if (pairings[p].has_partner) {
+            const TimedDetection& partner = recent[pairings[p].partner];
+            const TimedDetection& a = nearest.stamp_ns <= partner.stamp_ns ? nearest : partner;
+            const TimedDetection& b = nearest.stamp_ns <= partner.stamp_ns ? partner : nearest;
+            const int64_t span = b.stamp_ns - a.stamp_ns;
+            const float alpha = span > 0 ? static_cast<float>(stamp_ns - a.stamp_ns) / static_cast<float>(span) : 0.0f;
+            out[p].box.x_min = a.box.x_min + alpha * (b.box.x_min - a.box.x_min);
+            out[p].box.y_min = a.box.y_min + alpha * (b.box.y_min - a.box.y_min);
+            out[p].box.x_max = a.box.x_max + alpha * (b.box.x_max - a.box.x_max);
+            out[p].box.y_max = a.box.y_max + alpha * (b.box.y_max - a.box.y_max);
+        }
+    }
+    return n_pairings;
+}
+
+}  // namespace tflite_prop_detection
+
+#endif  // TFLITE_PROP_DETECTION_DETECTION_SYNC_H
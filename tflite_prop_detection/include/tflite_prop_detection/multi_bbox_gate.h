@@ -0,0 +1,211 @@
+/**
+ * @file multi_bbox_gate.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Gates one ToF frame against several detection bounding boxes in a single pass.
+ * The hires image is binned into tiles that know which boxes overlap them, so every
+ * point is only tested against the boxes of its own tile.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef TFLITE_PROP_DETECTION_MULTI_BBOX_GATE_H
+#define TFLITE_PROP_DETECTION_MULTI_BBOX_GATE_H
+
+#include <tflite_prop_detection/bbox_gate.h>
+#include <tflite_prop_detection/camera_projection.h>
+#include <tflite_prop_detection/depth_estimator.h>
+#include <your_pointcloud_package/tof_filter_transform.h>
+#include <Eigen/Core>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tflite_prop_detection {
+
+/**
+ * @brief Maximum number of detections gated together, one bit each in the tile masks
+ *
+ */
+constexpr size_t kMaxDetections = 16;
+
+/**
+ * @brief Image tiles with the bit mask of the boxes that overlap each of them
+ *
+ */
+class TiledBoxIndex {
+public:
+    /**
+     * @brief Sizes the tile grid for the image, the only allocation of the index
+     *
+     */
+    void resize(int image_width, int image_height, int tile_size) {
+        tile_size_ = std::max(tile_size, 1);
+        inv_tile_size_ = 1.0f / tile_size_;
+        tiles_x_ = (image_width + tile_size_ - 1) / tile_size_;
+        tiles_y_ = (image_height + tile_size_ - 1) / tile_size_;
+        masks_.assign(static_cast<size_t>(tiles_x_) * tiles_y_, 0);
+    }
+
+    /**
+     * @brief Marks the tiles covered by each box, n must not exceed kMaxDetections
+     *
+     */
+    void build(const BoundingBox* boxes, size_t n) {
+        std::fill(masks_.begin(), masks_.end(), 0);
+        for (size_t i = 0; i < n; ++i) {
+            const int tx0 = clampTile(boxes[i].x_min, tiles_x_);
+            const int tx1 = clampTile(boxes[i].x_max, tiles_x_);
+            const int ty0 = clampTile(boxes[i].y_min, tiles_y_);
+            const int ty1 = clampTile(boxes[i].y_max, tiles_y_);
+            for (int ty = ty0; ty <= ty1; ++ty) {
+                for (int tx = tx0; tx <= tx1; ++tx) {
+                    masks_[ty * tiles_x_ + tx] |= static_cast<uint16_t>(1u << i);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Boxes that may contain the pixel, 0 outside the image
+     *
+     */
+    uint16_t mask(float u, float v) const {
+        if (!(u >= 0.0f && v >= 0.0f)) {
+            return 0;
+        }
+        const int tx = static_cast<int>(u * inv_tile_size_);
+        const int ty = static_cast<int>(v * inv_tile_size_);
+        if (tx >= tiles_x_ || ty >= tiles_y_) {
+            return 0;
+        }
+        return masks_[ty * tiles_x_ + tx];
+    }
+
+private:
+    int clampTile(float pixel, int tiles) const {
+        const int tile = static_cast<int>(std::floor(pixel * inv_tile_size_));
+        return std::min(std::max(tile, 0), tiles - 1);
+    }
+
+    int tile_size_ = 32;
+    float inv_tile_size_ = 1.0f / 32;
+    int tiles_x_ = 0;
+    int tiles_y_ = 0;
+    std::vector<uint16_t> masks_;
+};
+
+/**
+ * @brief Gates the cloud against n boxes in one pass and fills moments[i] for box i,
+ * relative to moments[i].reference, histograms[i] unless histograms is null and
+ * points[i] unless points is null. The projection runs on 4 float packets like
+ * gateAndAccumulate, the box tests only touch the boxes listed by the point's tile.
+ *
+ */
+template <typename Fields>
+void gateAndAccumulateMulti(const uint8_t* data, const your_pointcloud_package::CloudLayout& layout,
+                            const Fields& fields, const CameraProjection& projection, const BoundingBox* boxes,
+                            size_t n, const TiledBoxIndex& index, const your_pointcloud_package::TofGate* tof_gate,
+                            GateMoments* moments, DepthHistogram* histograms = nullptr,
+                            GatedPoints* points = nullptr) {
+    using your_pointcloud_package::isFiniteBits;
+    for (size_t i = 0; i < n; ++i) {
+        moments[i].count = 0;
+        moments[i].sum.setZero();
+        moments[i].sum_sq.setZero();
+        if (histograms != nullptr) {
+            histograms[i].clear();
+        }
+        if (points != nullptr) {
+            points[i].clear();
+        }
+    }
+    const Eigen::Matrix<float, 3, 4>& P = projection.matrix();
+    const float inv_fx = 1.0f / projection.fx();
+    const float inv_fy = 1.0f / projection.fy();
+    Eigen::Array4f x, y, z, valid;
+    for (size_t row = 0; row < layout.height; ++row) {
+        const uint8_t* row_ptr = data + row * layout.row_step;
+        for (size_t col = 0; col < layout.width; col += 4) {
+            for (int lane = 0; lane < 4; ++lane) {
+                x[lane] = 0.0f;
+                y[lane] = 0.0f;
+                z[lane] = 0.0f;
+                valid[lane] = 0.0f;
+                if (col + lane >= layout.width) {
+                    continue;
+                }
+                float px, py, pz;
+                fields.load(row_ptr + (col + lane) * fields.step(), px, py, pz);
+                if (!(isFiniteBits(px) && isFiniteBits(py) && isFiniteBits(pz))) {
+                    continue;
+                }
+                // Also drops the all zero points of the pixels without a return, z_min > 0
+                if (tof_gate != nullptr && (pz < tof_gate->z_min || pz > tof_gate->z_max)) {
+                    continue;
+                }
+                x[lane] = px;
+                y[lane] = py;
+                z[lane] = pz;
+                valid[lane] = 1.0f;
+            }
+            const Eigen::Array4f hu = P(0, 0) * x + P(0, 1) * y + P(0, 2) * z + P(0, 3);
+            const Eigen::Array4f hv = P(1, 0) * x + P(1, 1) * y + P(1, 2) * z + P(1, 3);
+            const Eigen::Array4f d = P(2, 0) * x + P(2, 1) * y + P(2, 2) * z + P(2, 3);
+            const Eigen::Array4f inv_d = (d > 0.0f).select(d, Eigen::Array4f::Ones()).inverse();
+            const Eigen::Array4f u = hu * inv_d;
+            const Eigen::Array4f v = hv * inv_d;
+            for (int lane = 0; lane < 4; ++lane) {
+                if (valid[lane] == 0.0f || !(d[lane] > 0.0f)) {
+                    continue;
+                }
+                uint16_t mask = index.mask(u[lane], v[lane]);
+                if (mask == 0) {
+                    continue;
+                }
+                const Eigen::Vector3d point((hu[lane] - projection.cx() * d[lane]) * inv_fx,
+                                            (hv[lane] - projection.cy() * d[lane]) * inv_fy, d[lane]);
+                while (mask != 0) {
+                    const int i = __builtin_ctz(mask);
+                    mask &= static_cast<uint16_t>(mask - 1);
+                    const BoundingBox& box = boxes[i];
+                    if (u[lane] > box.x_min && u[lane] < box.x_max && v[lane] > box.y_min && v[lane] < box.y_max) {
+                        const Eigen::Vector3d centered = point - moments[i].reference;
+                        ++moments[i].count;
+                        moments[i].sum += centered;
+                        moments[i].sum_sq.noalias() += centered * centered.transpose();
+                        if (histograms != nullptr) {
+                            histograms[i].add(point.x(), point.y(), point.z());
+                        }
+                        if (points != nullptr) {
+                            points[i].add(point.x(), point.y(), point.z());
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief gateAndAccumulateMulti through the runtime field offsets, like gateAndAccumulate
+ *
+ */
+inline void gateAndAccumulateMulti(const uint8_t* data, const your_pointcloud_package::CloudLayout& layout,
+                                   const CameraProjection& projection, const BoundingBox* boxes, size_t n,
+                                   const TiledBoxIndex& index, const your_pointcloud_package::TofGate* tof_gate,
+                                   GateMoments* moments, DepthHistogram* histograms = nullptr,
+                                   GatedPoints* points = nullptr) {
+    gateAndAccumulateMulti(data, layout, your_pointcloud_package::RuntimeFields(layout), projection, boxes, n, index,
+                           tof_gate, moments, histograms, points);
+}
+
+}  // namespace tflite_prop_detection
+
+#endif  // TFLITE_PROP_DETECTION_MULTI_BBOX_GATE_H
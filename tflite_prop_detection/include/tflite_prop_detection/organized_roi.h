@@ -0,0 +1,267 @@
+/**
+ * @file organized_roi.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Region of interest on an organized cloud: the window of sensor pixels whose
+ * points can project into a detection bounding box, so the gate kernels only read that
+ * window instead of the whole ToF frame
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef TFLITE_PROP_DETECTION_ORGANIZED_ROI_H
+#define TFLITE_PROP_DETECTION_ORGANIZED_ROI_H
+
+#include <tflite_prop_detection/bbox_gate.h>
+#include <tflite_prop_detection/camera_projection.h>
+#include <your_pointcloud_package/tof_filter_transform.h>
+#include <Eigen/Core>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace tflite_prop_detection {
+
+/**
+ * @brief Rectangle of sensor pixels, rows [row0, row0 + rows), columns [col0, col0 + cols)
+ *
+ */
+struct PixelWindow {
+    uint32_t row0 = 0;
+    uint32_t col0 = 0;
+    uint32_t rows = 0;
+    uint32_t cols = 0;
+
+    size_t size() const { return static_cast<size_t>(rows) * cols; }
+
+    /**
+     * @brief Grows this window to also cover other
+     *
+     */
+    void merge(const PixelWindow& other) {
+        if (other.size() == 0) {
+            return;
+        }
+        if (size() == 0) {
+            *this = other;
+            return;
+        }
+        const uint32_t row1 = std::max(row0 + rows, other.row0 + other.rows);
+        const uint32_t col1 = std::max(col0 + cols, other.col0 + other.cols);
+        row0 = std::min(row0, other.row0);
+        col0 = std::min(col0, other.col0);
+        rows = row1 - row0;
+        cols = col1 - col0;
+    }
+};
+
+/**
+ * @brief View of a window of an organized cloud. The kernels walk it like a whole cloud
+ * starting at data + offset, nothing is copied.
+ *
+ */
+inline your_pointcloud_package::CloudLayout windowLayout(const your_pointcloud_package::CloudLayout& layout,
+                                                         const PixelWindow& window, size_t& offset) {
+    your_pointcloud_package::CloudLayout view = layout;
+    view.width = window.cols;
+    view.height = window.rows;
+    offset = static_cast<size_t>(window.row0) * layout.row_step + static_cast<size_t>(window.col0) * layout.point_step;
+    return view;
+}
+
+/**
+ * @brief Pinhole model of an organized depth sensor, fitted to the cloud itself. Every
+ * pixel of the VOXL ToF sees along a fixed ray, so col against x / z and row against
+ * y / z are fitted by least squares on a subsample of the valid points. The largest
+ * residual is kept, it covers the lens distortion the linear model leaves out.
+ *
+ */
+class OrganizedPinhole {
+public:
+    /**
+     * @brief Fits the model to one frame
+     *
+     * @param step Only every step-th row and column is used
+     * @return false if the cloud is not organized or has too few valid points, the
+     * previous model is dropped in that case
+     */
+    bool fit(const uint8_t* data, const your_pointcloud_package::CloudLayout& layout, uint32_t step = 4) {
+        valid_ = false;
+        if (layout.height < 2 || layout.width < 2) {
+            return false;
+        }
+        step = std::max(step, 1u);
+        // Sums for the two independent line fits col = fx * a + cx and row = fy * b + cy
+        double n = 0.0, sa = 0.0, saa = 0.0, sc = 0.0, sac = 0.0;
+        double sb = 0.0, sbb = 0.0, sr = 0.0, sbr = 0.0;
+        for (uint32_t row = 0; row < layout.height; row += step) {
+            for (uint32_t col = 0; col < layout.width; col += step) {
+                float a, b;
+                if (!ray(data, layout, row, col, a, b)) {
+                    continue;
+                }
+                n += 1.0;
+                sa += a;
+                saa += static_cast<double>(a) * a;
+                sc += col;
+                sac += static_cast<double>(a) * col;
+                sb += b;
+                sbb += static_cast<double>(b) * b;
+                sr += row;
+                sbr += static_cast<double>(b) * row;
+            }
+        }
+        const double var_a = n * saa - sa * sa;
+        const double var_b = n * sbb - sb * sb;
+        if (n < kMinPoints || var_a <= 0.0 || var_b <= 0.0) {
+            return false;
+        }
+        fx_ = static_cast<float>((n * sac - sa * sc) / var_a);
+        cx_ = static_cast<float>((sc - fx_ * sa) / n);
+        fy_ = static_cast<float>((n * sbr - sb * sr) / var_b);
+        cy_ = static_cast<float>((sr - fy_ * sb) / n);
+        max_residual_ = 0.0f;
+        for (uint32_t row = 0; row < layout.height; row += step) {
+            for (uint32_t col = 0; col < layout.width; col += step) {
+                float a, b;
+                if (!ray(data, layout, row, col, a, b)) {
+                    continue;
+                }
+                max_residual_ = std::max(max_residual_, std::abs(fx_ * a + cx_ - static_cast<float>(col)));
+                max_residual_ = std::max(max_residual_, std::abs(fy_ * b + cy_ - static_cast<float>(row)));
+            }
+        }
+        width_ = layout.width;
+        height_ = layout.height;
+        valid_ = true;
+        return true;
+    }
+
+    /**
+     * @brief True when a model was fitted to a cloud of the same size as layout
+     *
+     */
+    bool matches(const your_pointcloud_package::CloudLayout& layout) const {
+        return valid_ && layout.width == width_ && layout.height == height_;
+    }
+
+    void reset() { valid_ = false; }
+
+    /**
+     * @brief Pixel of a point in the sensor frame, false behind the sensor
+     *
+     */
+    bool pixel(const Eigen::Vector3f& point, float& col, float& row) const {
+        if (!(point.z() > kMinDepth)) {
+            return false;
+        }
+        col = fx_ * point.x() / point.z() + cx_;
+        row = fy_ * point.y() / point.z() + cy_;
+        return true;
+    }
+
+    uint32_t width() const { return width_; }
+    uint32_t height() const { return height_; }
+    float fx() const { return fx_; }
+    float fy() const { return fy_; }
+    float cx() const { return cx_; }
+    float cy() const { return cy_; }
+    float maxResidual() const { return max_residual_; }
+
+private:
+    static constexpr double kMinPoints = 64.0;
+    static constexpr float kMinDepth = 1e-3f;
+
+    static bool ray(const uint8_t* data, const your_pointcloud_package::CloudLayout& layout, uint32_t row,
+                    uint32_t col, float& a, float& b) {
+        using your_pointcloud_package::isFiniteBits;
+        using your_pointcloud_package::loadFloat;
+        const uint8_t* p = data + static_cast<size_t>(row) * layout.row_step +
+                           static_cast<size_t>(col) * layout.point_step;
+        const float x = loadFloat(p + layout.offset_x);
+        const float y = loadFloat(p + layout.offset_y);
+        const float z = loadFloat(p + layout.offset_z);
+        if (!(isFiniteBits(x) && isFiniteBits(y) && isFiniteBits(z)) || !(z > kMinDepth)) {
+            return false;
+        }
+        a = x / z;
+        b = y / z;
+        return true;
+    }
+
+    bool valid_ = false;
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    float fx_ = 1.0f;
+    float fy_ = 1.0f;
+    float cx_ = 0.0f;
+    float cy_ = 0.0f;
+    float max_residual_ = 0.0f;
+};
+
+/**
+ * @brief Window of the sensor pixels whose points can land inside box. The box is back
+ * projected at the near and far depth, the eight corners of that frustum are mapped
+ * into the sensor through the inverse extrinsic and the sensor model, and their
+ * bounding rectangle is grown by margin_px plus the largest residual of the model.
+ * A frustum maps onto the convex hull of its projected corners, so no pixel that can
+ * reach the box is left out. The window may come out empty when the box is outside the
+ * field of view of the sensor.
+ *
+ * @param sensor Fitted model of the organized cloud
+ * @param projection Projection of the cloud into the hires image
+ * @param box Detection bounding box in hires pixels
+ * @param near Nearest hires depth of interest, in the scaled units of the projection
+ * @param far Farthest hires depth of interest, in the scaled units of the projection
+ * @param margin_px Extra sensor pixels on every side
+ * @param window Filled with the window
+ * @return false if a corner falls behind the sensor, the whole cloud has to be scanned
+ */
+inline bool bboxWindow(const OrganizedPinhole& sensor, const CameraProjection& projection, const BoundingBox& box,
+                       float near, float far, float margin_px, PixelWindow& window) {
+    // No infinities, the package builds with -ffast-math
+    float col_min = std::numeric_limits<float>::max();
+    float col_max = std::numeric_limits<float>::lowest();
+    float row_min = col_min;
+    float row_max = col_max;
+    const float us[2] = {box.x_min, box.x_max};
+    const float vs[2] = {box.y_min, box.y_max};
+    const float depths[2] = {near, far};
+    for (float depth : depths) {
+        for (float u : us) {
+            for (float v : vs) {
+                float col, row;
+                if (!sensor.pixel(projection.toSource(projection.backProject(u, v, depth)), col, row)) {
+                    return false;
+                }
+                col_min = std::min(col_min, col);
+                col_max = std::max(col_max, col);
+                row_min = std::min(row_min, row);
+                row_max = std::max(row_max, row);
+            }
+        }
+    }
+    const float margin = margin_px + sensor.maxResidual();
+    // The sensor model may flip an axis, the bounds above are taken after the mapping
+    const float c0 = std::max(std::floor(col_min - margin), 0.0f);
+    const float c1 = std::min(std::ceil(col_max + margin) + 1.0f, static_cast<float>(sensor.width()));
+    const float r0 = std::max(std::floor(row_min - margin), 0.0f);
+    const float r1 = std::min(std::ceil(row_max + margin) + 1.0f, static_cast<float>(sensor.height()));
+    window = PixelWindow();
+    if (c1 > c0 && r1 > r0) {
+        window.col0 = static_cast<uint32_t>(c0);
+        window.row0 = static_cast<uint32_t>(r0);
+        window.cols = static_cast<uint32_t>(c1 - c0);
+        window.rows = static_cast<uint32_t>(r1 - r0);
+    }
+    return true;
+}
+
+}  // namespace tflite_prop_detection
+
+#endif  // TFLITE_PROP_DETECTION_ORGANIZED_ROI_H
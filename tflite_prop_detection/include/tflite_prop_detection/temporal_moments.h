@@ -0,0 +1,198 @@
+/**
+ * @file temporal_moments.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Temporal accumulation of the gated points of a track over its last frames. The
+ * moments of every frame are moved into the odometry frame with the camera pose of that
+ * frame, summed over a fixed window and moved back into the current camera frame, so a
+ * far target with a handful of points per frame keeps a stable centroid while the drone
+ * moves. Only the sums are kept, a frame costs O(1) to add and to evict.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef TFLITE_PROP_DETECTION_TEMPORAL_MOMENTS_H
+#define TFLITE_PROP_DETECTION_TEMPORAL_MOMENTS_H
+
+#include <tflite_prop_detection/bbox_gate.h>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace tflite_prop_detection {
+
+/**
+ * @brief Odometry sample as stored in the pose ring, trivially copyable. Pose of the
+ * body in the odometry frame, in meters.
+ *
+ */
+struct StampedPose {
+    int64_t stamp_ns;
+    double position[3];
+    // x, y, z, w
+    double orientation[4];
+};
+
+/**
+ * @brief Pose of the body at stamp_ns from recent odometry, linearly interpolated
+ * between the two samples around the stamp. A stamp past the newest sample holds that
+ * sample for up to max_hold_ns.
+ *
+ * @param recent Recent samples in any order
+ * @param n Number of recent samples
+ * @return false if the stamp is not covered
+ */
+inline bool interpolatePose(const StampedPose* recent, size_t n, int64_t stamp_ns, int64_t max_hold_ns,
+                            Eigen::Isometry3d& body_to_odom) {
+    const StampedPose* before = nullptr;
+    const StampedPose* after = nullptr;
+    for (size_t i = 0; i < n; ++i) {
+        const StampedPose& pose = recent[i];
+        if (pose.stamp_ns <= stamp_ns && (before == nullptr || pose.stamp_ns > before->stamp_ns)) {
+            before = &pose;
+        }
+        if (pose.stamp_ns >= stamp_ns && (after == nullptr || pose.stamp_ns < after->stamp_ns)) {
+            after = &pose;
+        }
+    }
+    if (before == nullptr) {
+        return false;
+    }
+    if (after == nullptr) {
+        if (stamp_ns - before->stamp_ns > max_hold_ns) {
+            return false;
+        }
+        after = before;
+    }
+    const Eigen::Map<const Eigen::Vector3d> p0(before->position), p1(after->position);
+    const Eigen::Quaterniond q0(before->orientation[3], before->orientation[0], before->orientation[1],
+                                before->orientation[2]);
+    const Eigen::Quaterniond q1(after->orientation[3], after->orientation[0], after->orientation[1],
+                                after->orientation[2]);
+    const int64_t span = after->stamp_ns - before->stamp_ns;
+    const double s = span > 0 ? static_cast<double>(stamp_ns - before->stamp_ns) / static_cast<double>(span) : 0.0;
+    body_to_odom.setIdentity();
+    body_to_odom.linear() = q0.normalized().slerp(s, q1.normalized()).toRotationMatrix();
+    body_to_odom.translation() = p0 + s * (p1 - p0);
+    return true;
+}
+
+/**
+ * @brief Sliding window over the moments of the last Capacity frames of one track. The
+ * frames are stored about a common reference in the odometry frame, the running totals
+ * are updated on every add and evict and restart from zero whenever the window empties.
+ *
+ * Poses are camera to odometry with the translation in mm, like the moments.
+ */
+template <size_t Capacity>
+class TemporalMoments {
+public:
+    /**
+     * @param length Frames kept, at most Capacity
+     * @param max_age_ns Frames older than this relative to the newest one are evicted
+     */
+    void configure(size_t length, int64_t max_age_ns) {
+        length_ = std::min(std::max<size_t>(length, 1), Capacity);
+        max_age_ns_ = max_age_ns;
+        clear();
+    }
+
+    void clear() {
+        head_ = 0;
+        size_ = 0;
+        total_ = Frame();
+    }
+
+    size_t frames() const { return size_; }
+
+    size_t count() const { return total_.count; }
+
+    /**
+     * @brief Adds the moments of the frame taken at stamp_ns, evicting the frames that
+     * fall out of the window
+     *
+     */
+    void add(const GateMoments& moments, const Eigen::Isometry3d& camera_to_odom, int64_t stamp_ns) {
+        while (size_ > 0 && (size_ == length_ || stamp_ns - oldest().stamp_ns > max_age_ns_)) {
+            evict();
+        }
+        const Eigen::Matrix3d& R = camera_to_odom.linear();
+        // The sums are relative to the frame reference, rotating them is enough
+        const Eigen::Vector3d reference = camera_to_odom * moments.reference;
+        const Eigen::Vector3d sum = R * moments.sum;
+        const Eigen::Matrix3d sum_sq = R * moments.sum_sq * R.transpose();
+        if (size_ == 0) {
+            reference_ = reference;
+        }
+        // Shift the sums onto the reference of the window
+        const Eigen::Vector3d delta = reference - reference_;
+        const double n = static_cast<double>(moments.count);
+        Frame& frame = frames_[(head_ + size_) % Capacity];
+        frame.stamp_ns = stamp_ns;
+        frame.count = moments.count;
+        frame.sum = sum + n * delta;
+        frame.sum_sq = sum_sq + sum * delta.transpose() + delta * sum.transpose() + n * delta * delta.transpose();
+        ++size_;
+        total_.count += frame.count;
+        total_.sum += frame.sum;
+        total_.sum_sq += frame.sum_sq;
+    }
+
+    /**
+     * @brief Moments of every point in the window, in the camera frame of camera_to_odom
+     *
+     */
+    GateMoments moments(const Eigen::Isometry3d& camera_to_odom) const {
+        const Eigen::Matrix3d Rt = camera_to_odom.linear().transpose();
+        GateMoments window;
+        window.count = total_.count;
+        window.reference = camera_to_odom.inverse() * reference_;
+        window.sum = Rt * total_.sum;
+        window.sum_sq = Rt * total_.sum_sq * Rt.transpose();
+        return window;
+    }
+
+private:
+    struct Frame {
+        int64_t stamp_ns = 0;
+        size_t count = 0;
+        Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+        Eigen::Matrix3d sum_sq = Eigen::Matrix3d::Zero();
+    };
+
+    const Frame& oldest() const { return frames_[head_]; }
+
+    void evict() {
+        const Frame& frame = frames_[head_];
+        head_ = (head_ + 1) % Capacity;
+        --size_;
+        if (size_ == 0) {
+            // Nothing left to subtract from, drop the rounding the running sums gathered
+            total_ = Frame();
+            return;
+        }
+        total_.count -= frame.count;
+        total_.sum -= frame.sum;
+        total_.sum_sq -= frame.sum_sq;
+    }
+
+    std::array<Frame, Capacity> frames_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+    size_t length_ = 1;
+    int64_t max_age_ns_ = 0;
+    // Reference of the sums in the odometry frame, set by the first frame of the window
+    Eigen::Vector3d reference_ = Eigen::Vector3d::Zero();
+    // Running sums over the frames in the window
+    Frame total_;
+};
+
+}  // namespace tflite_prop_detection
+
+#endif  // TFLITE_PROP_DETECTION_TEMPORAL_MOMENTS_H
@@ -0,0 +1,142 @@
+/**
+ * @file tflite_prop_detection.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief TFLitePropDetectionNode subscribes to the pointcloud2 topic /rgb_pcl and
+ * /tflite_data and publishes the centroid of the points inside the bounding box. Used
+ * by the standalone node and by the nodelet.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef TFLITE_PROP_DETECTION_TFLITE_PROP_DETECTION_H
+#define TFLITE_PROP_DETECTION_TFLITE_PROP_DETECTION_H
+
+#include <geometry_msgs/PointStamped.h>
+#include <nav_msgs/Odometry.h>
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <std_msgs/Bool.h>
+#include <std_msgs/UInt8.h>
+#include <voxl_mpa_to_ros/AiDetection.h>
+#include <tf2_ros/buffer.h>
+#include <tf2_ros/transform_listener.h>
+#include <tflite_prop_detection/ObjectCentroidArray.h>
+#include <tflite_prop_detection/detection_processor.h>
+#include <pipeline_diagnostics/stage_diagnostics.h>
+#include <your_pointcloud_package/callback_thread.h>
+#include <your_pointcloud_package/load_governor.h>
+#include <your_pointcloud_package/message_pool.h>
+#include <your_pointcloud_package/transform_cache.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace tflite_prop_detection {
+
+/**
+ * @brief TFLitePropDetectionNode class that subscribes to the pointcloud2 topic /rgb_pcl and /tflite_data
+ *
+ */
+class TFLitePropDetectionNode {
+public:
+    /**
+     * @brief Subscribes and advertises on nh, parameters are read from pnh
+     *
+     */
+    TFLitePropDetectionNode(ros::NodeHandle nh, ros::NodeHandle pnh);
+
+    /**
+     * @brief Joins the callback threads before the subscriptions go away
+     *
+     */
+    ~TFLitePropDetectionNode();
+
+    void aidectionCallback(const voxl_mpa_to_ros::AiDetection::ConstPtr& msg);
+
+    void pclCallback(const sensor_msgs::PointCloud2ConstPtr& msg);
+
+    void odometryCallback(const nav_msgs::Odometry::ConstPtr& msg);
+
+private:
+    // Stages timed on /diagnostics, they follow the stages of the processor
+    enum Stage : size_t {
+        kStagePublish = DetectionProcessor::kStageCount,
+        kStageCallback,
+        kStageAgeIn,
+        kStageAgeOut,
+        kStageFrameInterval,
+    };
+    // Counters on /diagnostics
+    enum Counter : size_t {
+        kCounterDropped,
+        // Clouds dropped by the governor because they arrived too old
+        kCounterStale,
+        // Gauge of the governor level
+        kCounterQualityLevel,
+        // Gauges of the pools, see StageDiagnostics::poolGauges
+        kCounterCentroidPool,
+        kCounterCentroidsPool = kCounterCentroidPool + 4,
+    };
+
+    /**
+     * @brief Refreshes the fused camera matrix from the cached source->hires extrinsic
+     * when the node consumes the raw ToF cloud
+     *
+     * @return false if the extrinsic is not available yet
+     */
+    bool updateProjection(const std::string& source_frame);
+
+    /**
+     * @brief Refreshes the hires->body transform of the temporal window
+     *
+     */
+    void updateCameraMount();
+
+    /**
+     * @brief Pairs, gates and publishes the centroids for a cloud, the part of
+     * pclCallback the governor times
+     *
+     */
+    void locateAndPublish(const sensor_msgs::PointCloud2ConstPtr& msg);
+
+    ros::Subscriber sub_tflite_data_;
+    ros::Subscriber sub_pcl_;
+    ros::Subscriber sub_odometry_;
+    ros::Publisher pub_object_centroid_;
+    ros::Publisher pub_object_centroids_;
+    std_msgs::Bool object_available_;
+    ros::Publisher pub_object_available_;
+    // Latched level of the governor
+    ros::Publisher pub_quality_level_;
+    ros::Time last_pcl_callback_time_;
+    // Receipt time of the last detection with a positive confidence, written by the
+    // detection callback
+    std::atomic<int64_t> last_detection_ns_;
+    // /detections and /detections_array are published by pointer from these pools, the
+    // kalman tracker nodelet reads them without a copy and hands them back
+    std::unique_ptr<your_pointcloud_package::MessagePool<geometry_msgs::PointStamped>> centroid_pool_;
+    std::unique_ptr<your_pointcloud_package::MessagePool<ObjectCentroidArray>> centroids_pool_;
+    std::unique_ptr<tf2_ros::Buffer> tf_buffer_;
+    std::unique_ptr<tf2_ros::TransformListener> tf_listener_;
+    std::unique_ptr<your_pointcloud_package::TransformCache> transform_cache_;
+    std::unique_ptr<pipeline_diagnostics::StageDiagnostics> diagnostics_;
+    // Pairing, gating and estimation, shared with the offline pipeline
+    std::unique_ptr<DetectionProcessor> processor_;
+    // Clouds that never reached pclCallback, from the gaps in header.seq
+    pipeline_diagnostics::SequenceGap cloud_gap_;
+    // Drops stale clouds and sets the quality level of processor_ from the callback time
+    your_pointcloud_package::LoadGovernor governor_;
+    // Each subscription runs on its own thread so a slow cloud never delays a detection,
+    // null when the callbacks share the queue of nh
+    std::unique_ptr<your_pointcloud_package::CallbackThread> detection_thread_;
+    std::unique_ptr<your_pointcloud_package::CallbackThread> cloud_thread_;
+};
+
+}  // namespace tflite_prop_detection
+
+#endif  // TFLITE_PROP_DETECTION_TFLITE_PROP_DETECTION_H
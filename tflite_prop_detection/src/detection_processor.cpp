@@ -0,0 +1,440 @@
+/**
+ * @file detection_processor.cpp
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Implementation of the detection to cloud pairing, the gating and the centroid
+ * estimation of the detection stage
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <tflite_prop_detection/detection_processor.h>
+#include <your_pointcloud_package/point_cloud2_layout.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace tflite_prop_detection {
+
+std::vector<std::string> DetectionProcessor::stageNames() {
+    std::vector<std::string> stages{"associate", "layout", "project_gate", "estimate", "roi", "cluster",
+                                     "temporal"};
+    for (int e = 0; e < kDepthEstimatorCount; ++e) {
+        stages.push_back(std::string("estimate_") + depthEstimatorName(static_cast<DepthEstimator>(e)));
+    }
+    return stages;
+}
+
+DetectionProcessor::DetectionProcessor(const DetectionConfig& config, pipeline_diagnostics::StageStats& stats)
+    : config_(config), stats_(stats), camera_to_body_(Eigen::Isometry3d::Identity()), has_camera_mount_(false),
+      n_tracks_(0), n_gated_(0), next_track_id_(0),
+      K_pcl_(Eigen::Matrix<float, 3, 4>::Zero()), use_roi_(false), roi_margin_px_(0.0f), roi_near_mm_(0.0f),
+      roi_far_mm_(0.0f) {
+    // Initialize K_pcl_ with appropriate values and then divide it by 1000 to convert it to meters
+    // K_pcl_ << 756.3252575983485, 0, 565.876453177986, 0,
+    //           0, 751.995016895224, 360.3127057589527, 0,
+    //           0, 0, 1, 0;
+    K_pcl_ << 756.3252575983485, 0, 0.0, 0,
+              0, 751.995016895224, 0.0, 0,
+              0, 0, 1, 0;
+    image_width_ = 1024;
+    image_height_ = 768;
+    // The projection keeps the historical principal point at the image centre
+    projection_.set(K_pcl_(0, 0), K_pcl_(1, 1), image_width_ / 2, image_height_ / 2, 1000.0f,
+                    Eigen::Matrix<float, 3, 4>::Identity());
+    box_index_.resize(image_width_, image_height_, config_.tile_size);
+    for (DepthHistogram& histogram : histograms_) {
+        histogram.configure(config_.depth_min_mm, config_.depth_max_mm);
+    }
+    if (config_.cluster != ClusterSelection::kNone) {
+        // Every buffer is sized up front, clustering never allocates per frame
+        const size_t max_points = static_cast<size_t>(config_.cluster_max_points);
+        for (GatedPoints& points : gated_points_) {
+            points.reserve(max_points);
+        }
+        cluster_grid_.reserve(max_points);
+    }
+    spare_objects_.reserve(kMaxDetections);
+    for (TrackedDetection& track : tracks_) {
+        track.window.configure(config_.temporal_frames, static_cast<int64_t>(config_.temporal_max_age * 1e9));
+    }
+    if (config_.project_raw_tof) {
+        use_roi_ = config_.roi;
+        setQualityLevel(0);
+    }
+}
+
+void DetectionProcessor::setQualityLevel(int level) {
+    if (!config_.project_raw_tof) {
+        return;
+    }
+    level = std::max(level, 0);
+    // The gate keeps at least 10 cm of depth
+    const double z_max = std::max(config_.z_max - level * config_.z_step, config_.z_min + 0.1);
+    tof_gate_.z_min = config_.z_min;
+    tof_gate_.z_max = z_max;
+    roi_margin_px_ = static_cast<float>(std::ldexp(std::max(config_.roi_margin_px, 0.0), -level));
+    roi_near_mm_ = static_cast<float>(std::max(config_.z_min - config_.roi_depth_margin, 0.01) * 1000.0);
+    roi_far_mm_ = static_cast<float>((z_max + config_.roi_depth_margin) * 1000.0);
+}
+
+TimedDetection DetectionProcessor::toTimedDetection(const voxl_mpa_to_ros::AiDetection& msg,
+                                                    const ros::Time& receipt) const {
+    TimedDetection detection;
+    detection.stamp_ns = config_.stamp_from_detection
+                             ? msg.timestamp_ns
+                             : static_cast<int64_t>((receipt - ros::Duration(config_.detection_latency)).toNSec());
+    detection.class_id = msg.class_id;
+    detection.confidence = msg.class_confidence;
+    detection.box = BoundingBox{msg.x_min, msg.y_min, msg.x_max, msg.y_max};
+    const size_t name_length = std::min(msg.class_name.size(), sizeof(detection.class_name) - 1);
+    std::memcpy(detection.class_name, msg.class_name.data(), name_length);
+    detection.class_name[name_length] = '\0';
+    return detection;
+}
+
+StampedPose DetectionProcessor::toStampedPose(const nav_msgs::Odometry& msg) {
+    const geometry_msgs::Pose& pose = msg.pose.pose;
+    StampedPose stamped;
+    stamped.stamp_ns = static_cast<int64_t>(msg.header.stamp.toNSec());
+    stamped.position[0] = pose.position.x;
+    stamped.position[1] = pose.position.y;
+    stamped.position[2] = pose.position.z;
+    stamped.orientation[0] = pose.orientation.x;
+    stamped.orientation[1] = pose.orientation.y;
+    stamped.orientation[2] = pose.orientation.z;
+    stamped.orientation[3] = pose.orientation.w;
+    return stamped;
+}
+
+void DetectionProcessor::setCameraMount(const Eigen::Matrix<float, 3, 4>& hires_to_body) {
+    camera_to_body_.linear() = hires_to_body.leftCols<3>().cast<double>();
+    camera_to_body_.translation() = hires_to_body.col(3).cast<double>() * 1000.0;
+    has_camera_mount_ = true;
+}
+
+bool DetectionProcessor::cameraPose(const ros::Time& stamp, Eigen::Isometry3d& camera_to_odom) {
+    if (!has_camera_mount_) {
+        return false;
+    }
+    const size_t n_recent = pose_ring_.snapshot(recent_poses_.data(), recent_poses_.size());
+    Eigen::Isometry3d body_to_odom;
+    if (!interpolatePose(recent_poses_.data(), n_recent, static_cast<int64_t>(stamp.toNSec()),
+                         static_cast<int64_t>(config_.pose_hold * 1e9), body_to_odom)) {
+        return false;
+    }
+    // The moments are in mm
+    body_to_odom.translation() *= 1000.0;
+    camera_to_odom = body_to_odom * camera_to_body_;
+    return true;
+}
+
+void DetectionProcessor::setExtrinsic(const Eigen::Matrix<float, 3, 4>& source_to_hires) {
+    projection_.set(K_pcl_(0, 0), K_pcl_(1, 1), image_width_ / 2, image_height_ / 2, 1000.0f, source_to_hires);
+}
+
+bool DetectionProcessor::roiWindow(const uint8_t* data, const your_pointcloud_package::CloudLayout& layout,
+                                   size_t n_boxes, PixelWindow& window) {
+    if (!sensor_model_.matches(layout)) {
+        if (!sensor_model_.fit(data, layout)) {
+            ROS_WARN_THROTTLE(5.0, "Could not fit a sensor model to the %ux%u cloud, gating all of it",
+                              layout.width, layout.height);
+            return false;
+        }
+        ROS_INFO("ToF sensor model for the %ux%u cloud: fx %.2f fy %.2f cx %.2f cy %.2f, residual %.2f px",
+                 layout.width, layout.height, sensor_model_.fx(), sensor_model_.fy(), sensor_model_.cx(),
+                 sensor_model_.cy(), sensor_model_.maxResidual());
+    }
+    window = PixelWindow();
+    for (size_t i = 0; i < n_boxes; ++i) {
+        PixelWindow box_window;
+        if (!bboxWindow(sensor_model_, projection_, boxes_[i], roi_near_mm_, roi_far_mm_, roi_margin_px_,
+                        box_window)) {
+            return false;
+        }
+        window.merge(box_window);
+    }
+    return true;
+}
+
+void DetectionProcessor::expireTracks(const ros::Time& stamp) {
+    size_t i = 0;
+    while (i < n_tracks_) {
+        if ((stamp - tracks_[i].last_seen).toSec() > config_.detection_window) {
+            // Swap the last active track into the free slot
+            std::swap(tracks_[i], tracks_[n_tracks_ - 1]);
+            --n_tracks_;
+        } else {
+            ++i;
+        }
+    }
+}
+
+size_t DetectionProcessor::updateTrack(const TimedDetection& detection, const ros::Time& stamp, size_t first) {
+    size_t slot = n_tracks_;
+    float best_iou = static_cast<float>(config_.track_iou);
+    for (size_t i = first; i < n_tracks_; ++i) {
+        if (tracks_[i].class_id != detection.class_id) {
+            continue;
+        }
+        const float iou = intersectionOverUnion(tracks_[i].box, detection.box);
+        if (iou >= best_iou) {
+            best_iou = iou;
+            slot = i;
+        }
+    }
+    if (slot == n_tracks_) {
+        if (n_tracks_ < kMaxDetections) {
+            ++n_tracks_;
+        } else {
+            ROS_WARN_THROTTLE(1.0, "More than %zu active detections, replacing the oldest", kMaxDetections);
+            slot = first;
+            for (size_t i = first + 1; i < n_tracks_; ++i) {
+                if (tracks_[i].last_seen < tracks_[slot].last_seen) {
+                    slot = i;
+                }
+            }
+        }
+        TrackedDetection& track = tracks_[slot];
+        track.track_id = next_track_id_++;
+        track.class_id = detection.class_id;
+        track.class_name = detection.class_name;
+        track.reference = Eigen::Vector3d(0.0, 0.0, 1000.0);
+        track.window.clear();
+    }
+    TrackedDetection& track = tracks_[slot];
+    track.confidence = detection.confidence;
+    track.box = detection.box;
+    track.last_seen = stamp;
+    return slot;
+}
+
+Eigen::Vector3f DetectionProcessor::estimateCentroid(DepthEstimator estimator, size_t i) const {
+    switch (estimator) {
+        case DepthEstimator::kMode: return estimateMode(histograms_[i]);
+        case DepthEstimator::kMedian: return estimateMedian(histograms_[i], moments_[i].count);
+        case DepthEstimator::kTrimmedMean:
+            return estimateTrimmedMean(histograms_[i], moments_[i].count, static_cast<float>(config_.trim_fraction));
+        default: return moments_[i].centroid();
+    }
+}
+
+void DetectionProcessor::clusterBox(size_t i, bool fill_histograms) {
+    const GatedPoints& gated = gated_points_[i];
+    if (gated.dropped > 0) {
+        ROS_WARN_THROTTLE(1.0, "%zu gated points do not fit cluster_max_points %d, keeping the whole box",
+                          gated.size + gated.dropped, config_.cluster_max_points);
+        return;
+    }
+    if (gated.size == 0) {
+        return;
+    }
+    const Eigen::Vector3f* points = gated.points.data();
+    const size_t n_clusters =
+        cluster_grid_.cluster(points, gated.size, static_cast<float>(config_.cluster_tolerance));
+    const int selected = cluster_grid_.select(config_.cluster, points, projection_, boxes_[i],
+                                              static_cast<size_t>(config_.cluster_min_points));
+    if (selected < 0) {
+        ROS_DEBUG("[%d] No cluster of %d points among %zu, keeping the whole box", tracks_[i].track_id,
+                  config_.cluster_min_points, n_clusters);
+        return;
+    }
+    ROS_DEBUG("[%d] Cluster %d of %zu: %zu of %zu points", tracks_[i].track_id, selected, n_clusters,
+              cluster_grid_.cluster(selected).count, gated.size);
+    // Accumulate again around the same reference, only over the selected cluster
+    GateMoments& moments = moments_[i];
+    moments.count = 0;
+    moments.sum.setZero();
+    moments.sum_sq.setZero();
+    if (fill_histograms) {
+        histograms_[i].clear();
+    }
+    for (size_t j = 0; j < gated.size; ++j) {
+        if (cluster_grid_.label(j) != selected) {
+            continue;
+        }
+        const Eigen::Vector3d centered = points[j].cast<double>() - moments.reference;
+        ++moments.count;
+        moments.sum += centered;
+        moments.sum_sq.noalias() += centered * centered.transpose();
+        if (fill_histograms) {
+            histograms_[i].add(points[j].x(), points[j].y(), points[j].z());
+        }
+    }
+}
+
+size_t DetectionProcessor::pairDetections(const ros::Time& stamp) {
+    // Pair the cloud with the boxes seen closest to its own stamp rather than with the
+    // last box that arrived
+    pipeline_diagnostics::ScopedStageTimer timer(stats_[kStageAssociate]);
+    const size_t n_recent = detection_ring_.snapshot(recent_detections_.data(), recent_detections_.size());
+    const size_t n_paired = associateDetections<kDetectionRingSize>(
+        recent_detections_.data(), n_recent, static_cast<int64_t>(stamp.toNSec()),
+        static_cast<int64_t>(config_.max_skew * 1e9), static_cast<float>(config_.track_iou),
+        paired_detections_.data(), paired_detections_.size());
+    expireTracks(stamp);
+    // The tracks paired with this cloud are moved to the front, in gating order
+    n_gated_ = 0;
+    for (size_t i = 0; i < n_paired; ++i) {
+        const size_t slot = updateTrack(paired_detections_[i], stamp, n_gated_);
+        std::swap(tracks_[slot], tracks_[n_gated_]);
+        ++n_gated_;
+    }
+    return n_gated_;
+}
+
+int DetectionProcessor::locateObjects(const sensor_msgs::PointCloud2& msg, ObjectCentroidArray& centroids) {
+    const size_t n_gated = n_gated_;
+    your_pointcloud_package::CloudLayout layout;
+    bool layout_ok;
+    {
+        pipeline_diagnostics::ScopedStageTimer timer(stats_[kStageLayout]);
+        layout_ok = your_pointcloud_package::resolveCloudLayout(msg, layout);
+    }
+    if (!layout_ok) {
+        ROS_WARN_THROTTLE(1.0, "Point cloud has no float32 x, y, z fields, skipping");
+        return -1;
+    }
+    // Project, gate and accumulate in one pass over the message buffer. Nothing is
+    // copied or stored, the centroids and covariances come out of the running sums.
+    for (size_t i = 0; i < n_gated; ++i) {
+        boxes_[i] = tracks_[i].box;
+        moments_[i].reference = tracks_[i].reference;
+    }
+    const your_pointcloud_package::TofGate* tof_gate = config_.project_raw_tof ? &tof_gate_ : nullptr;
+    // On the organized ToF cloud only the window of pixels that can reach a box is read,
+    // the filtered /rgb_pcl is unorganized and always scanned whole
+    const uint8_t* data = msg.data.data();
+    your_pointcloud_package::CloudLayout gate_layout = layout;
+    if (use_roi_ && layout.height > 1) {
+        pipeline_diagnostics::ScopedStageTimer timer(stats_[kStageRoi]);
+        PixelWindow window;
+        if (roiWindow(data, layout, n_gated, window)) {
+            size_t offset;
+            gate_layout = windowLayout(layout, window, offset);
+            data += offset;
+            ROS_DEBUG("Gating a %ux%u window, %.1f %% of the cloud", window.cols, window.rows,
+                      100.0 * window.size() / layout.size());
+        }
+    }
+    // The histograms are filled in the same pass, only when an estimator reads them
+    const bool fill_histograms = config_.depth_estimator != DepthEstimator::kMean || config_.report_estimators;
+    // The points themselves are only kept for the clustering
+    const bool clustering = config_.cluster != ClusterSelection::kNone;
+    {
+        // Projection and gating are one fused pass, they share a timer
+        pipeline_diagnostics::ScopedStageTimer timer(stats_[kStageProjectGate]);
+        if (n_gated == 1) {
+            // A single box keeps the fully vectorized kernel
+            gateAndAccumulate(data, gate_layout, projection_, boxes_[0], tof_gate, moments_[0],
+                              fill_histograms ? &histograms_[0] : nullptr, clustering ? &gated_points_[0] : nullptr);
+        } else {
+            // Every point is tested only against the boxes overlapping its image tile
+            box_index_.build(boxes_.data(), n_gated);
+            gateAndAccumulateMulti(data, gate_layout, projection_, boxes_.data(), n_gated, box_index_,
+                                   tof_gate, moments_.data(), fill_histograms ? histograms_.data() : nullptr,
+                                   clustering ? gated_points_.data() : nullptr);
+        }
+    }
+    if (clustering) {
+        pipeline_diagnostics::ScopedStageTimer timer(stats_[kStageCluster]);
+        for (size_t i = 0; i < n_gated; ++i) {
+            clusterBox(i, fill_histograms);
+        }
+    }
+
+    // Every gated track adds this frame to its window, also without points so the window
+    // keeps counting frames
+    bool windowed = false;
+    if (temporal()) {
+        pipeline_diagnostics::ScopedStageTimer timer(stats_[kStageTemporal]);
+        Eigen::Isometry3d camera_to_odom;
+        if (cameraPose(msg.header.stamp, camera_to_odom)) {
+            const int64_t stamp_ns = static_cast<int64_t>(msg.header.stamp.toNSec());
+            for (size_t i = 0; i < n_gated; ++i) {
+                tracks_[i].window.add(moments_[i], camera_to_odom, stamp_ns);
+                window_moments_[i] = tracks_[i].window.moments(camera_to_odom);
+            }
+            windowed = true;
+        } else {
+            ROS_WARN_THROTTLE(1.0, "No odometry around the cloud stamp, using the current frame only");
+        }
+    }
+
+    centroids.header.stamp = msg.header.stamp;
+    centroids.header.frame_id = "hires";
+    // The objects are overwritten in place. Growing takes the objects trimmed off earlier
+    // messages from spare_objects_, so their class names keep their buffers however the
+    // number of objects changes from frame to frame.
+    centroids.objects.reserve(kMaxDetections);
+    size_t n_objects = 0;
+    // /detections keeps carrying a single centroid, the one of the most confident detection
+    int primary = -1;
+    {
+        pipeline_diagnostics::ScopedStageTimer timer(stats_[kStageEstimate]);
+        for (size_t i = 0; i < n_gated; ++i) {
+            const GateMoments& moments = windowed ? window_moments_[i] : moments_[i];
+            ROS_DEBUG("Count of filtered points [%d]: %zu", tracks_[i].track_id, moments.count);
+            if (moments.count == 0) {
+                continue;
+            }
+            if (config_.report_estimators && moments_[i].count > 0) {
+                for (int e = 0; e < kDepthEstimatorCount; ++e) {
+                    Eigen::Vector3f estimate;
+                    {
+                        pipeline_diagnostics::ScopedStageTimer timer(stats_[kStageEstimators + e]);
+                        estimate = estimateCentroid(static_cast<DepthEstimator>(e), i);
+                    }
+                    ROS_DEBUG("[%d] %s: %.1f %.1f %.1f mm", tracks_[i].track_id,
+                              depthEstimatorName(static_cast<DepthEstimator>(e)), estimate(0), estimate(1),
+                              estimate(2));
+                }
+            }
+            // The histogram estimators read the current frame and reject the background, the
+            // window stands in when the frame has no points of the track
+            const Eigen::Vector3f centroid =
+                windowed && (config_.depth_estimator == DepthEstimator::kMean || moments_[i].count == 0)
+                    ? moments.centroid()
+                    : estimateCentroid(config_.depth_estimator, i);
+            // The next frame accumulates around this centroid
+            tracks_[i].reference = centroid.cast<double>();
+            ROS_DEBUG_STREAM("Covariance of the gated points [" << tracks_[i].track_id << "]:\n"
+                             << moments.covariance());
+            if (n_objects == centroids.objects.size()) {
+                if (spare_objects_.empty()) {
+                    centroids.objects.emplace_back();
+                } else {
+                    centroids.objects.push_back(std::move(spare_objects_.back()));
+                    spare_objects_.pop_back();
+                }
+            }
+            ObjectCentroid& object = centroids.objects[n_objects];
+            object.track_id = tracks_[i].track_id;
+            object.class_id = tracks_[i].class_id;
+            object.class_name = tracks_[i].class_name;
+            object.confidence = tracks_[i].confidence;
+            object.num_points = moments.count;
+            object.centroid.x = centroid(0);
+            object.centroid.y = centroid(1);
+            object.centroid.z = centroid(2);
+            if (primary < 0 || object.confidence > centroids.objects[primary].confidence) {
+                primary = static_cast<int>(n_objects);
+            }
+            ++n_objects;
+        }
+    }
+    while (centroids.objects.size() > n_objects) {
+        // Beyond the reserved spares the object is freed rather than grow the spares
+        if (spare_objects_.size() < spare_objects_.capacity()) {
+            spare_objects_.push_back(std::move(centroids.objects.back()));
+        }
+        centroids.objects.pop_back();
+    }
+    return primary;
+}
+
+}  // namespace tflite_prop_detection
@@ -0,0 +1,549 @@
+/**
+ * @file offline_pipeline.cpp
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Replays /tof_pc, /tflite_data and the odometry from a bag through the transform, detection
+ * and tracking code in-process, as fast as the stages run and without a roscore, and
+ * writes the detections to a CSV file or a results bag.
+ *
+ *   rosrun tflite_prop_detection offline_pipeline flight.bag results.csv [name:=value ...]
+ *
+ * The parameters are the private parameters of the three nodes, e.g.
+ * projection_mode:=tof depth_estimator:=median init_detections:=3
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <geometry_msgs/PointStamped.h>
+#include <nav_msgs/Odometry.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <tf2/buffer_core.h>
+#include <tf2_msgs/TFMessage.h>
+#include <voxl_mpa_to_ros/AiDetection.h>
+#include <kalman_filter_ros/centroid_tracker.h>
+#include <tflite_prop_detection/ObjectCentroidArray.h>
+#include <tflite_prop_detection/detection_processor.h>
+#include <pipeline_diagnostics/latency_stats.h>
+#include <your_pointcloud_package/tof_cloud_processor.h>
+#include <your_pointcloud_package/transform_cache.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using tflite_prop_detection::DetectionProcessor;
+using tflite_prop_detection::ObjectCentroidArray;
+using pipeline_diagnostics::ScopedStageTimer;
+using pipeline_diagnostics::StageStats;
+
+/**
+ * @brief Parameters given on the command line as name:=value, read through the same
+ * param(name, value, default) calls as a private ros::NodeHandle
+ *
+ */
+class CommandLineParams {
+public:
+    /**
+     * @brief Takes name:=value, a leading underscore is accepted like for rosrun
+     *
+     * @return false if arg is not of that form
+     */
+    bool add(const std::string& arg) {
+        const size_t separator = arg.find(":=");
+        if (separator == std::string::npos || separator == 0) {
+            return false;
+        }
+        std::string name = arg.substr(0, separator);
+        if (name[0] == '_') {
+            name.erase(0, 1);
+        }
+        values_[name] = arg.substr(separator + 2);
+        return true;
+    }
+
+    template <typename T>
+    bool param(const std::string& name, T& value, const T& default_value) const {
+        used_.insert(name);
+        const auto it = values_.find(name);
+        if (it == values_.end()) {
+            value = default_value;
+            return false;
+        }
+        if (!parse(it->second, value)) {
+            ROS_WARN("Could not parse %s:=%s, using the default", name.c_str(), it->second.c_str());
+            value = default_value;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Warns about the parameters no stage read, usually typos
+     *
+     */
+    void warnUnused() const {
+        for (const auto& entry : values_) {
+            if (used_.count(entry.first) == 0) {
+                ROS_WARN("Parameter %s is not used", entry.first.c_str());
+            }
+        }
+    }
+
+private:
+    static bool parse(const std::string& text, std::string& value) {
+        value = text;
+        return true;
+    }
+
+    static bool parse(const std::string& text, int& value) {
+        std::istringstream stream(text);
+        return static_cast<bool>(stream >> value) && stream.eof();
+    }
+
+    static bool parse(const std::string& text, double& value) {
+        std::istringstream stream(text);
+        return static_cast<bool>(stream >> value) && stream.eof();
+    }
+
+    static bool parse(const std::string& text, bool& value) {
+        if (text == "true" || text == "True" || text == "1") {
+            value = true;
+        } else if (text == "false" || text == "False" || text == "0") {
+            value = false;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // [6, 7, 8] or 6,7,8, [] for an empty list
+    static bool parse(const std::string& text, std::vector<int>& value) {
+        std::string list = text;
+        std::replace(list.begin(), list.end(), ',', ' ');
+        list.erase(std::remove(list.begin(), list.end(), '['), list.end());
+        list.erase(std::remove(list.begin(), list.end(), ']'), list.end());
+        std::istringstream stream(list);
+        value.clear();
+        int element;
+        while (stream >> element) {
+            value.push_back(element);
+        }
+        return stream.eof();
+    }
+
+    std::map<std::string, std::string> values_;
+    mutable std::set<std::string> used_;
+};
+
+/**
+ * @brief One message travelling down the pipeline. Every event passes every stage in
+ * bag order, so a stage sees the detections, transforms and clouds interleaved exactly
+ * as they were recorded.
+ *
+ */
+struct Event {
+    enum Type { kTransforms, kDetection, kOdometry, kCloud, kCentroids, kEnd };
+    Type type = kEnd;
+    // Record time in the bag, stands in for the receipt time of the nodes
+    ros::Time time;
+    tf2_msgs::TFMessage::ConstPtr transforms;
+    voxl_mpa_to_ros::AiDetection::ConstPtr detection;
+    nav_msgs::Odometry::ConstPtr odometry;
+    sensor_msgs::PointCloud2ConstPtr cloud;
+    // Output of the detection stage
+    ObjectCentroidArray::Ptr centroids;
+    int primary = -1;
+    // Whether /object_available would have been true when the cloud arrived
+    bool object_available = false;
+};
+
+/**
+ * @brief Bounded queue between two stage threads, a full queue blocks the producer so
+ * the reader never runs ahead of the slowest stage by more than the capacity
+ *
+ */
+class EventQueue {
+public:
+    explicit EventQueue(size_t capacity) : capacity_(std::max<size_t>(capacity, 1)) {}
+
+    void push(Event event) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this]() { return events_.size() < capacity_; });
+        events_.push_back(std::move(event));
+        not_empty_.notify_one();
+    }
+
+    Event pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this]() { return !events_.empty(); });
+        Event event = std::move(events_.front());
+        events_.pop_front();
+        not_full_.notify_one();
+        return event;
+    }
+
+private:
+    const size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<Event> events_;
+};
+
+/**
+ * @brief Runs process on every event of in until the end marker, forwarding the events
+ * it returns true for and the end marker to out
+ *
+ */
+template <typename Process>
+void runStage(EventQueue& in, EventQueue* out, pipeline_diagnostics::LatencyHistogram& busy, Process process) {
+    while (true) {
+        Event event = in.pop();
+        if (event.type == Event::kEnd) {
+            if (out != nullptr) {
+                out->push(std::move(event));
+            }
+            return;
+        }
+        bool forward;
+        {
+            ScopedStageTimer timer(busy);
+            forward = process(event);
+        }
+        if (forward && out != nullptr) {
+            out->push(std::move(event));
+        }
+    }
+}
+
+void addTransforms(tf2::BufferCore& buffer, const tf2_msgs::TFMessage& msg, bool is_static) {
+    for (const auto& transform : msg.transforms) {
+        buffer.setTransform(transform, "bag", is_static);
+    }
+}
+
+void printStats(StageStats& stats, const char* prefix) {
+    for (size_t i = 0; i < stats.size(); ++i) {
+        const pipeline_diagnostics::LatencyHistogram::Summary summary = stats[i].drain();
+        if (summary.count == 0) {
+            continue;
+        }
+        std::printf("  %-10s %-24s %8lu x  mean %9.1f  p50 %9.1f  p99 %9.1f  max %9.1f us\n", prefix,
+                    stats.name(i).c_str(), static_cast<unsigned long>(summary.count), summary.mean_us,
+                    summary.p50_us, summary.p99_us, summary.max_us);
+    }
+}
+
+bool endsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    // Only the clock, there is no master to talk to
+    ros::Time::init();
+    std::vector<std::string> files;
+    CommandLineParams params;
+    for (int i = 1; i < argc; ++i) {
+        if (!params.add(argv[i])) {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.size() != 2 || !(endsWith(files[1], ".csv") || endsWith(files[1], ".bag"))) {
+        std::fprintf(stderr, "Usage: %s input.bag output.{csv,bag} [name:=value ...]\n", argv[0]);
+        return 1;
+    }
+    const std::string& input_path = files[0];
+    const std::string& output_path = files[1];
+    const bool write_bag = endsWith(output_path, ".bag");
+
+    std::string tof_topic, detection_topic;
+    int queue_size;
+    params.param("tof_topic", tof_topic, std::string("/tof_pc"));
+    params.param("detection_topic", detection_topic, std::string("/tflite_data"));
+    params.param("queue_size", queue_size, 64);
+    your_pointcloud_package::TofCloudConfig cloud_config;
+    cloud_config.load(params);
+    tflite_prop_detection::DetectionConfig detection_config;
+    detection_config.load(params);
+    double process_noise, measurement_noise, prediction_rate;
+    int init_detections;
+    params.param("process_noise", process_noise, 0.01);
+    params.param("measurement_noise", measurement_noise, 0.1);
+    params.param("prediction_rate", prediction_rate, 30.0);
+    params.param("init_detections", init_detections, 5);
+    prediction_rate = std::max(prediction_rate, 1.0);
+    params.warnUnused();
+
+    rosbag::Bag input;
+    try {
+        input.open(input_path, rosbag::bagmode::Read);
+    } catch (const rosbag::BagException& e) {
+        ROS_ERROR("Could not open %s: %s", input_path.c_str(), e.what());
+        return 1;
+    }
+    std::ofstream csv;
+    rosbag::Bag output;
+    try {
+        if (write_bag) {
+            output.open(output_path, rosbag::bagmode::Write);
+        } else {
+            csv.open(output_path);
+            if (!csv) {
+                ROS_ERROR("Could not open %s for writing", output_path.c_str());
+                return 1;
+            }
+            csv << "stamp,track_id,class_id,class_name,confidence,num_points,x,y,z,primary,kf_x,kf_y,kf_z\n";
+        }
+    } catch (const rosbag::BagException& e) {
+        ROS_ERROR("Could not open %s: %s", output_path.c_str(), e.what());
+        return 1;
+    }
+
+    // The static extrinsics are latched once at the start of a recording, they are
+    // loaded before the replay. Every stage that resolves frames keeps its own buffer and
+    // applies /tf in stream order.
+    const bool project_raw_tof = detection_config.project_raw_tof;
+    tf2::BufferCore transform_tf, detection_tf;
+    {
+        rosbag::View static_view(input, rosbag::TopicQuery(std::vector<std::string>{"/tf_static"}));
+        for (const rosbag::MessageInstance& m : static_view) {
+            const tf2_msgs::TFMessage::ConstPtr msg = m.instantiate<tf2_msgs::TFMessage>();
+            if (msg) {
+                addTransforms(transform_tf, *msg, true);
+                addTransforms(detection_tf, *msg, true);
+            }
+        }
+    }
+    your_pointcloud_package::TransformCache transform_cache(transform_tf);
+    your_pointcloud_package::TransformCache detection_cache(detection_tf);
+
+    StageStats pipeline_stats({"read", "transform", "detect", "track"});
+    StageStats cloud_stats(your_pointcloud_package::TofCloudProcessor::stageNames());
+    StageStats detection_stats(DetectionProcessor::stageNames());
+    your_pointcloud_package::TofCloudProcessor cloud_processor(cloud_config, cloud_stats);
+    DetectionProcessor detection_processor(detection_config, detection_stats);
+    kalman_filter_ros::CentroidTracker tracker(process_noise, measurement_noise, 1.0 / prediction_rate,
+                                               init_detections);
+
+    EventQueue to_transform(queue_size), to_detect(queue_size), to_track(queue_size);
+    size_t n_clouds = 0, n_detections = 0, n_located = 0;
+    // Counted by the transform and the detection stage
+    std::atomic<size_t> n_skipped(0);
+    ros::Time first_time, last_time;
+    const auto wall_start = std::chrono::steady_clock::now();
+
+    // read: decodes the bag in record order
+    std::thread reader([&]() {
+        std::vector<std::string> topics{tof_topic, detection_topic, "/tf"};
+        if (detection_processor.temporal()) {
+            topics.push_back(detection_config.odometry_topic);
+        }
+        rosbag::View view(input, rosbag::TopicQuery(topics));
+        for (const rosbag::MessageInstance& m : view) {
+            Event event;
+            {
+                ScopedStageTimer timer(pipeline_stats[0]);
+                event.time = m.getTime();
+                if (m.getTopic() == tof_topic) {
+                    event.type = Event::kCloud;
+                    event.cloud = m.instantiate<sensor_msgs::PointCloud2>();
+                } else if (m.getTopic() == detection_topic) {
+                    event.type = Event::kDetection;
+                    event.detection = m.instantiate<voxl_mpa_to_ros::AiDetection>();
+                } else if (m.getTopic() == detection_config.odometry_topic) {
+                    event.type = Event::kOdometry;
+                    event.odometry = m.instantiate<nav_msgs::Odometry>();
+                } else {
+                    event.type = Event::kTransforms;
+                    event.transforms = m.instantiate<tf2_msgs::TFMessage>();
+                }
+                if (!event.cloud && !event.detection && !event.odometry && !event.transforms) {
+                    ROS_WARN_ONCE("Skipping %s messages of an unexpected type", m.getTopic().c_str());
+                    continue;
+                }
+                if (first_time.isZero()) {
+                    first_time = event.time;
+                }
+                last_time = event.time;
+            }
+            to_transform.push(std::move(event));
+        }
+        to_transform.push(Event());
+    });
+
+    // transform: /tof_pc into the hires frame, like pointcloud_transformer. Skipped when
+    // the detection stage projects the raw cloud.
+    std::thread transformer([&]() {
+        runStage(to_transform, &to_detect, pipeline_stats[1], [&](Event& event) {
+            if (event.type == Event::kTransforms) {
+                addTransforms(transform_tf, *event.transforms, false);
+                return true;
+            }
+            if (event.type != Event::kCloud || project_raw_tof) {
+                return true;
+            }
+            Eigen::Matrix<float, 3, 4> world_to_hires;
+            std::string tf_error;
+            if (!transform_cache.lookup("hires", event.cloud->header.frame_id, world_to_hires, &tf_error)) {
+                ROS_WARN_THROTTLE(1.0, "No transform from %s to hires: %s", event.cloud->header.frame_id.c_str(),
+                                  tf_error.c_str());
+                ++n_skipped;
+                return false;
+            }
+            sensor_msgs::PointCloud2Ptr transformed(new sensor_msgs::PointCloud2());
+            your_pointcloud_package::TofCloudProcessor::initOutput(*transformed);
+            if (!cloud_processor.process(*event.cloud, world_to_hires, *transformed)) {
+                ROS_WARN_THROTTLE(1.0, "Point cloud on %s has no float32 x, y, z fields, skipping",
+                                  tof_topic.c_str());
+                ++n_skipped;
+                return false;
+            }
+            event.cloud = transformed;
+            return true;
+        });
+    });
+
+    // detect: pairs every cloud with the detections recorded before it, like the
+    // detection node with both callbacks on one queue
+    std::thread detector([&]() {
+        int64_t last_detection_ns = 0;
+        runStage(to_detect, &to_track, pipeline_stats[2], [&](Event& event) {
+            if (event.type == Event::kTransforms) {
+                addTransforms(detection_tf, *event.transforms, false);
+                return false;
+            }
+            if (event.type == Event::kDetection) {
+                ++n_detections;
+                detection_processor.addDetection(detection_processor.toTimedDetection(*event.detection, event.time));
+                if (event.detection->class_confidence > 0) {
+                    last_detection_ns = static_cast<int64_t>(event.time.toNSec());
+                }
+                return false;
+            }
+            if (event.type == Event::kOdometry) {
+                detection_processor.addPose(DetectionProcessor::toStampedPose(*event.odometry));
+                return false;
+            }
+            ++n_clouds;
+            const sensor_msgs::PointCloud2& cloud = *event.cloud;
+            if (detection_processor.pairDetections(cloud.header.stamp) == 0) {
+                return false;
+            }
+            if (project_raw_tof) {
+                Eigen::Matrix<float, 3, 4> source_to_hires;
+                std::string tf_error;
+                if (!detection_cache.lookup("hires", cloud.header.frame_id, source_to_hires, &tf_error)) {
+                    ROS_WARN_THROTTLE(1.0, "No transform from %s to hires: %s", cloud.header.frame_id.c_str(),
+                                      tf_error.c_str());
+                    ++n_skipped;
+                    return false;
+                }
+                detection_processor.setExtrinsic(source_to_hires);
+            }
+            if (detection_processor.temporal()) {
+                const std::string& body_frame = detection_config.body_frame;
+                Eigen::Matrix<float, 3, 4> hires_to_body;
+                std::string tf_error;
+                if (detection_cache.lookup(body_frame, "hires", hires_to_body, &tf_error)) {
+                    detection_processor.setCameraMount(hires_to_body);
+                } else {
+                    ROS_WARN_THROTTLE(1.0, "No transform from hires to %s: %s", body_frame.c_str(), tf_error.c_str());
+                }
+            }
+            event.centroids.reset(new ObjectCentroidArray());
+            event.primary = detection_processor.locateObjects(cloud, *event.centroids);
+            if (event.primary < 0) {
+                return false;
+            }
+            event.type = Event::kCentroids;
+            event.object_available = static_cast<int64_t>(event.time.toNSec()) - last_detection_ns <=
+                                     static_cast<int64_t>(detection_processor.config().detection_window * 1e9);
+            event.cloud.reset();
+            return true;
+        });
+    });
+
+    // track: the Kalman filter on the primary centroid, and the output
+    std::thread writer([&]() {
+        runStage(to_track, nullptr, pipeline_stats[3], [&](Event& event) {
+            ++n_located;
+            const ObjectCentroidArray& centroids = *event.centroids;
+            const ros::Time stamp = centroids.header.stamp;
+            const geometry_msgs::Point& primary = centroids.objects[event.primary].centroid;
+            const bool tracked =
+                tracker.update(stamp, kalman_filter_ros::ConstantVelocityKalman::Measurement(primary.x, primary.y,
+                                                                                            primary.z)) &&
+                event.object_available;
+            const kalman_filter_ros::ConstantVelocityKalman::Measurement position = tracker.position();
+            if (write_bag) {
+                // Stamped with the cloud instead of the wall clock, so two runs give the same bag
+                geometry_msgs::PointStamped centroid_msg;
+                centroid_msg.header.stamp = stamp;
+                centroid_msg.point = primary;
+                output.write("/detections", event.time, centroid_msg);
+                output.write("/detections_array", event.time, centroids);
+                if (tracked) {
+                    geometry_msgs::PointStamped predicted_msg;
+                    predicted_msg.header.stamp = stamp;
+                    predicted_msg.point.x = position(0);
+                    predicted_msg.point.y = position(1);
+                    predicted_msg.point.z = position(2);
+                    output.write("/predicted_positions", event.time, predicted_msg);
+                }
+                return false;
+            }
+            for (size_t i = 0; i < centroids.objects.size(); ++i) {
+                const tflite_prop_detection::ObjectCentroid& object = centroids.objects[i];
+                csv << stamp << ',' << object.track_id << ',' << object.class_id << ',' << object.class_name << ','
+                    << object.confidence << ',' << object.num_points << ',' << object.centroid.x << ','
+                    << object.centroid.y << ',' << object.centroid.z << ','
+                    << (static_cast<int>(i) == event.primary ? 1 : 0);
+                if (tracked && static_cast<int>(i) == event.primary) {
+                    csv << ',' << position(0) << ',' << position(1) << ',' << position(2) << '\n';
+                } else {
+                    csv << ",,,\n";
+                }
+            }
+            return false;
+        });
+    });
+
+    reader.join();
+    transformer.join();
+    detector.join();
+    writer.join();
+    const double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    input.close();
+    if (write_bag) {
+        output.close();
+    }
+
+    const double bag_s = (last_time - first_time).toSec();
+    std::printf("%zu clouds, %zu detections, %zu frames located, %zu skipped\n", n_clouds, n_detections,
+                n_located, n_skipped.load());
+    std::printf("%.1f s of bag in %.2f s, %.1fx real time\n", bag_s, wall_s, wall_s > 0.0 ? bag_s / wall_s : 0.0);
+    printStats(pipeline_stats, "pipeline");
+    printStats(cloud_stats, "transform");
+    printStats(detection_stats, "detect");
+    return 0;
+}
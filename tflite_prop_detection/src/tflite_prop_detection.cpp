@@ -0,0 +1,215 @@
+/**
+ * @file tflite_prop_detection.cpp
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Implementation of TFLitePropDetectionNode which fuses the bounding boxes on
+ * /tflite_data with the ToF points on /rgb_pcl and publishes the centroid of the points
+ * inside that bounding box
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <tflite_prop_detection/tflite_prop_detection.h>
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace tflite_prop_detection {
+
+TFLitePropDetectionNode::TFLitePropDetectionNode(ros::NodeHandle nh, ros::NodeHandle pnh)
+    : last_detection_ns_(0) {
+    pub_object_centroid_ = nh.advertise<geometry_msgs::PointStamped>("/detections", 15);
+    pub_object_available_ = nh.advertise<std_msgs::Bool>("/object_available", 15);
+    pub_object_centroids_ = nh.advertise<ObjectCentroidArray>("/detections_array", 15);
+    last_pcl_callback_time_ = ros::Time::now();
+    DetectionConfig config;
+    config.load(pnh);
+    if (config.project_raw_tof || config.temporal_frames > 1) {
+        tf_buffer_.reset(new tf2_ros::Buffer());
+        tf_listener_.reset(new tf2_ros::TransformListener(*tf_buffer_, nh));
+        transform_cache_.reset(new your_pointcloud_package::TransformCache(*tf_buffer_));
+        // The extrinsics are static, the dynamic /tf of VIO does not evict them
+        transform_cache_->subscribeStatic(nh);
+    }
+    std::vector<std::string> stages = DetectionProcessor::stageNames();
+    stages.insert(stages.end(), {"publish", "callback", "age_in", "age_out", "frame_interval"});
+    std::vector<std::string> counters{"dropped", "stale", "quality_level"};
+    for (const char* pool : {"centroid_pool", "centroids_pool"}) {
+        const std::vector<std::string> gauges = pipeline_diagnostics::StageDiagnostics::poolGauges(pool);
+        counters.insert(counters.end(), gauges.begin(), gauges.end());
+    }
+    diagnostics_.reset(new pipeline_diagnostics::StageDiagnostics(nh, pnh, "tflite_prop_detection",
+                                                                  std::move(stages), std::move(counters)));
+    processor_.reset(new DetectionProcessor(config, diagnostics_->stats()));
+    your_pointcloud_package::GovernorConfig governor_config;
+    governor_config.load(pnh);
+    governor_ = your_pointcloud_package::LoadGovernor(governor_config);
+    pub_quality_level_ = pnh.advertise<std_msgs::UInt8>("quality_level", 1, true);
+    std_msgs::UInt8 level;
+    level.data = 0;
+    pub_quality_level_.publish(level);
+    int message_pool_size;
+    pnh.param("message_pool_size", message_pool_size, 4);
+    const size_t pool_size = static_cast<size_t>(std::max(message_pool_size, 1));
+    centroid_pool_.reset(new your_pointcloud_package::MessagePool<geometry_msgs::PointStamped>(pool_size));
+    centroids_pool_.reset(new your_pointcloud_package::MessagePool<ObjectCentroidArray>(
+        pool_size, [](ObjectCentroidArray& centroids) {
+            centroids.header.frame_id = "hires";
+            centroids.objects.reserve(kMaxDetections);
+        }));
+    // Cores are numbered like the CPUS enum (1 = CPU1), 0 leaves a thread unpinned. The
+    // cloud thread defaults to a big core next to the transform workers.
+    bool callback_threads;
+    int detection_cpu, cloud_cpu, detection_queue_size, cloud_queue_size;
+    pnh.param("callback_threads", callback_threads, true);
+    pnh.param("detection_cpu", detection_cpu, 0);
+    pnh.param("cloud_cpu", cloud_cpu, 5);
+    // Several detections arrive back to back for one image, a queue of 1 drops all but one
+    pnh.param("detection_queue_size", detection_queue_size, 16);
+    pnh.param("cloud_queue_size", cloud_queue_size, 1);
+    ros::NodeHandle detection_nh = nh;
+    ros::NodeHandle cloud_nh = nh;
+    if (callback_threads) {
+        detection_thread_.reset(new your_pointcloud_package::CallbackThread(nh, "detection", detection_cpu));
+        cloud_thread_.reset(new your_pointcloud_package::CallbackThread(nh, "cloud", cloud_cpu));
+        detection_nh = detection_thread_->nodeHandle();
+        cloud_nh = cloud_thread_->nodeHandle();
+    }
+    sub_tflite_data_ = detection_nh.subscribe("/tflite_data", std::max(detection_queue_size, 1),
+                                              &TFLitePropDetectionNode::aidectionCallback, this);
+    // Odometry is light, it shares the detection thread
+    if (processor_->temporal()) {
+        sub_odometry_ = detection_nh.subscribe(config.odometry_topic, 32, &TFLitePropDetectionNode::odometryCallback,
+                                               this);
+    }
+    // The cloud arrives as a shared pointer, inside one nodelet manager it is the very
+    // message published by the transform nodelet
+    sub_pcl_ = cloud_nh.subscribe(processor_->cloudTopic(), std::max(cloud_queue_size, 1),
+                                  &TFLitePropDetectionNode::pclCallback, this);
+}
+
+TFLitePropDetectionNode::~TFLitePropDetectionNode() {
+    if (detection_thread_) {
+        detection_thread_->stop();
+    }
+    if (cloud_thread_) {
+        cloud_thread_->stop();
+    }
+    sub_tflite_data_.shutdown();
+    sub_pcl_.shutdown();
+    sub_odometry_.shutdown();
+}
+
+bool TFLitePropDetectionNode::updateProjection(const std::string& source_frame) {
+    Eigen::Matrix<float, 3, 4> source_to_hires;
+    std::string tf_error;
+    if (!transform_cache_->lookup("hires", source_frame, source_to_hires, &tf_error)) {
+        ROS_WARN_THROTTLE(1.0, "No transform from %s to hires: %s", source_frame.c_str(), tf_error.c_str());
+        return false;
+    }
+    processor_->setExtrinsic(source_to_hires);
+    return true;
+}
+
+void TFLitePropDetectionNode::updateCameraMount() {
+    const std::string& body_frame = processor_->config().body_frame;
+    Eigen::Matrix<float, 3, 4> hires_to_body;
+    std::string tf_error;
+    if (!transform_cache_->lookup(body_frame, "hires", hires_to_body, &tf_error)) {
+        ROS_WARN_THROTTLE(1.0, "No transform from hires to %s: %s", body_frame.c_str(), tf_error.c_str());
+        return;
+    }
+    processor_->setCameraMount(hires_to_body);
+}
+
+void TFLitePropDetectionNode::odometryCallback(const nav_msgs::Odometry::ConstPtr& msg) {
+    processor_->addPose(DetectionProcessor::toStampedPose(*msg));
+}
+
+void TFLitePropDetectionNode::aidectionCallback(const voxl_mpa_to_ros::AiDetection::ConstPtr& msg) {
+    // Only the ring and the atomic stamp are shared with the cloud callback, so both
+    // callbacks can run at the same time on their own threads
+    const ros::Time now = ros::Time::now();
+    processor_->addDetection(processor_->toTimedDetection(*msg, now));
+    if (msg->class_confidence > 0) {
+        last_detection_ns_.store(static_cast<int64_t>(now.toNSec()), std::memory_order_relaxed);
+        ROS_DEBUG("Bbox values: %.0f %.0f %.0f %.0f", msg->x_min, msg->y_min, msg->x_max, msg->y_max);
+    }
+    std_msgs::Bool available;
+    available.data = static_cast<int64_t>(now.toNSec()) - last_detection_ns_.load(std::memory_order_relaxed) <=
+                     static_cast<int64_t>(processor_->config().detection_window * 1e9);
+    pub_object_available_.publish(available);
+}
+
+void TFLitePropDetectionNode::pclCallback(const sensor_msgs::PointCloud2ConstPtr& msg) {
+    pipeline_diagnostics::StageDiagnostics& diagnostics = *diagnostics_;
+    const auto start = std::chrono::steady_clock::now();
+    const ros::Time receipt = ros::Time::now();
+    diagnostics.recordAge(kStageAgeIn, msg->header.stamp, receipt);
+    // Frames the subscriber queue overflowed on, or that an upstream stage skipped
+    diagnostics.count(kCounterDropped, cloud_gap_.update(msg->header.seq));
+    // The processing rate shows up as the frame interval on /diagnostics
+    diagnostics[kStageFrameInterval].record((receipt - last_pcl_callback_time_).toNSec());
+    last_pcl_callback_time_ = receipt;
+    // A centroid from an old cloud would only feed the tracker a stale position
+    if (!msg->header.stamp.isZero() &&
+        governor_.stale(static_cast<int64_t>((receipt - msg->header.stamp).toNSec()))) {
+        diagnostics.count(kCounterStale);
+        ROS_DEBUG_THROTTLE(1.0, "Dropping a cloud %.3f s old", (receipt - msg->header.stamp).toSec());
+        return;
+    }
+    locateAndPublish(msg);
+    if (governor_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count())) {
+        processor_->setQualityLevel(governor_.level());
+        ROS_INFO("Detection quality level %d of %d", governor_.level(), governor_.config().max_level);
+        std_msgs::UInt8 level;
+        level.data = static_cast<uint8_t>(governor_.level());
+        pub_quality_level_.publish(level);
+    }
+    diagnostics.set(kCounterQualityLevel, static_cast<uint64_t>(governor_.level()));
+}
+
+void TFLitePropDetectionNode::locateAndPublish(const sensor_msgs::PointCloud2ConstPtr& msg) {
+    pipeline_diagnostics::StageDiagnostics& diagnostics = *diagnostics_;
+    pipeline_diagnostics::ScopedStageTimer callback_timer(diagnostics[kStageCallback]);
+    const size_t n_gated = processor_->pairDetections(msg->header.stamp);
+    if (n_gated == 0) {
+        ROS_DEBUG("No bbox");
+        return;
+    }
+
+    if (processor_->config().project_raw_tof && !updateProjection(msg->header.frame_id)) {
+        return;
+    }
+
+    if (processor_->temporal()) {
+        updateCameraMount();
+    }
+
+    const boost::shared_ptr<ObjectCentroidArray> centroids = centroids_pool_->acquire();
+    const int primary = processor_->locateObjects(*msg, *centroids);
+    if (primary >= 0) {
+        const geometry_msgs::Point& centroid = centroids->objects[primary].centroid;
+        ROS_DEBUG("Centroid: %.1f %.1f %.1f", centroid.x, centroid.y, centroid.z);
+        const boost::shared_ptr<geometry_msgs::PointStamped> centroid_msg = centroid_pool_->acquire();
+        centroid_msg->point = centroid;
+        {
+            pipeline_diagnostics::ScopedStageTimer timer(diagnostics[kStagePublish]);
+            centroid_msg->header.stamp = ros::Time::now();
+            pub_object_centroid_.publish(centroid_msg);
+            pub_object_centroids_.publish(centroids);
+        }
+        diagnostics.recordAge(kStageAgeOut, msg->header.stamp, centroid_msg->header.stamp);
+        diagnostics.setPoolGauges(kCounterCentroidPool, centroid_pool_->stats());
+        diagnostics.setPoolGauges(kCounterCentroidsPool, centroids_pool_->stats());
+        object_available_.data = true;
+    }
+    else {
+        object_available_.data = false;
+    }
+}
+
+}  // namespace tflite_prop_detection
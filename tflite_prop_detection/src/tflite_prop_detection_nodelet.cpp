@@ -0,0 +1,32 @@
+/**
+ * @file tflite_prop_detection_nodelet.cpp
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Nodelet wrapper around TFLitePropDetectionNode. Loaded in the same manager as
+ * the pointcloud transformer nodelet it receives /rgb_pcl without serialization or copy
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <tflite_prop_detection/tflite_prop_detection.h>
+
+#include <memory>
+
+namespace tflite_prop_detection {
+
+class TFLitePropDetectionNodelet : public nodelet::Nodelet {
+private:
+    void onInit() override {
+        node_.reset(new TFLitePropDetectionNode(getNodeHandle(), getPrivateNodeHandle()));
+    }
+
+    std::unique_ptr<TFLitePropDetectionNode> node_;
+};
+
+}  // namespace tflite_prop_detection
+
+PLUGINLIB_EXPORT_CLASS(tflite_prop_detection::TFLitePropDetectionNodelet, nodelet::Nodelet)
@@ -0,0 +1,157 @@
+/**
+ * @file detection_processor_test.cpp
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Checks that the detection stage runs without heap allocations once it is warm,
+ * with class names too long for the small string buffer. Counts every operator new of
+ * the process, no roscore needed.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <gtest/gtest.h>
+#include <tflite_prop_detection/detection_processor.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+static std::atomic<uint64_t> g_allocations{0};
+
+void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    const std::size_t align = static_cast<std::size_t>(alignment);
+    if (void* p = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// GCC cannot tell that the replaced operator new above is the malloc behind these
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpragmas"
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+#pragma GCC diagnostic pop
+
+namespace tflite_prop_detection {
+
+namespace {
+
+// Longer than the 15 characters std::string keeps without a heap buffer
+const char* const kClassNames[] = {"propeller_guard_front_left", "propeller_guard_rear_right",
+                                   "propeller_guard_top_center"};
+
+/**
+ * @brief Unorganized /rgb_pcl cloud in meters: a blob in front of the camera, one to the
+ * lower right and, with upper_left, one in the upper left corner of the image
+ *
+ */
+sensor_msgs::PointCloud2 hiresCloud(bool upper_left) {
+    std::vector<Eigen::Vector3f> points;
+    uint32_t state = 1;
+    const auto next = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) / static_cast<float>(1u << 24) * 2.0f - 1.0f;
+    };
+    for (int i = 0; i < 200; ++i) {
+        points.emplace_back(0.05f * next(), 0.05f * next(), 0.9f + 0.02f * next());
+        points.emplace_back(0.3f + 0.03f * next(), 0.1f + 0.03f * next(), 1.0f + 0.02f * next());
+        if (upper_left) {
+            points.emplace_back(-0.65f + 0.02f * next(), -0.45f + 0.02f * next(), 1.2f + 0.02f * next());
+        }
+    }
+    sensor_msgs::PointCloud2 cloud;
+    const char* const names[] = {"x", "y", "z"};
+    for (uint32_t k = 0; k < 3; ++k) {
+        sensor_msgs::PointField field;
+        field.name = names[k];
+        field.offset = 4 * k;
+        field.datatype = sensor_msgs::PointField::FLOAT32;
+        field.count = 1;
+        cloud.fields.push_back(field);
+    }
+    cloud.height = 1;
+    cloud.width = static_cast<uint32_t>(points.size());
+    cloud.point_step = 16;
+    cloud.row_step = cloud.width * cloud.point_step;
+    cloud.is_bigendian = false;
+    cloud.is_dense = true;
+    cloud.data.resize(cloud.row_step);
+    for (size_t i = 0; i < points.size(); ++i) {
+        const float point[4] = {points[i].x(), points[i].y(), points[i].z(), 1.0f};
+        std::memcpy(cloud.data.data() + i * cloud.point_step, point, sizeof(point));
+    }
+    return cloud;
+}
+
+TimedDetection detectionAt(const ros::Time& stamp, uint32_t class_id, const BoundingBox& box) {
+    TimedDetection detection{};
+    detection.stamp_ns = static_cast<int64_t>(stamp.toNSec());
+    detection.class_id = class_id;
+    detection.confidence = 0.5f + 0.1f * class_id;
+    detection.box = box;
+    std::strncpy(detection.class_name, kClassNames[class_id], sizeof(detection.class_name) - 1);
+    return detection;
+}
+
+}  // namespace
+
+TEST(DetectionProcessor, LocateObjectsDoesNotAllocateOnceWarm) {
+    const DetectionConfig config;
+    pipeline_diagnostics::StageStats stats(DetectionProcessor::stageNames());
+    DetectionProcessor processor(config, stats);
+    // The box in the upper left only has points every other frame, so the number of
+    // objects alternates between 2 and 3
+    const sensor_msgs::PointCloud2 clouds[] = {hiresCloud(false), hiresCloud(true)};
+    const BoundingBox boxes[] = {BoundingBox{440.0f, 310.0f, 590.0f, 460.0f},
+                                 BoundingBox{690.0f, 420.0f, 790.0f, 500.0f},
+                                 BoundingBox{50.0f, 50.0f, 150.0f, 150.0f}};
+    ObjectCentroidArray centroids;
+    constexpr int kWarmFrames = 4;
+    constexpr int kFrames = 50;
+    uint64_t allocations = 0;
+    int primary = -1;
+    for (int frame = 0; frame < kWarmFrames + kFrames; ++frame) {
+        const uint64_t before = g_allocations.load(std::memory_order_relaxed);
+        const ros::Time stamp(100.0 + 0.033 * frame);
+        for (uint32_t k = 0; k < 3; ++k) {
+            processor.addDetection(detectionAt(stamp, k, boxes[k]));
+        }
+        if (processor.pairDetections(stamp) > 0) {
+            primary = processor.locateObjects(clouds[frame % 2], centroids);
+        }
+        if (frame >= kWarmFrames) {
+            allocations += g_allocations.load(std::memory_order_relaxed) - before;
+        }
+    }
+    EXPECT_EQ(allocations, 0u);
+    // The last frame has the upper left blob
+    ASSERT_EQ(centroids.objects.size(), 3u);
+    ASSERT_GE(primary, 0);
+    EXPECT_EQ(centroids.objects[primary].class_name, kClassNames[2]);
+    for (const ObjectCentroid& object : centroids.objects) {
+        EXPECT_EQ(object.class_name, kClassNames[object.class_id]);
+        EXPECT_GT(object.num_points, 100u);
+    }
+}
+
+}  // namespace tflite_prop_detection
@@ -0,0 +1,639 @@
+/**
+ * @file kernel_test.cpp
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Checks the ROS free kernels of the detection stage against naive references on
+ * a few fixed clouds: the box gates and their moments, the depth estimators, the
+ * detection ring and association, the temporal moments and the cluster grid. The ToF
+ * clouds are written with both packed layouts and a generic one.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <test_clouds.h>
+
+#include <gtest/gtest.h>
+#include <tflite_prop_detection/bbox_gate.h>
+#include <tflite_prop_detection/camera_projection.h>
+#include <tflite_prop_detection/cluster_grid.h>
+#include <tflite_prop_detection/depth_estimator.h>
+#include <tflite_prop_detection/detection_sync.h>
+#include <tflite_prop_detection/multi_bbox_gate.h>
+#include <tflite_prop_detection/temporal_moments.h>
+#include <Eigen/Geometry>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace tflite_prop_detection {
+
+namespace {
+
+using your_pointcloud_package::TofGate;
+using your_pointcloud_package::isFiniteBits;
+using your_pointcloud_package::test::Cloud;
+using your_pointcloud_package::test::Placement;
+using your_pointcloud_package::test::blob;
+using your_pointcloud_package::test::kPlacements;
+using your_pointcloud_package::test::kSceneWidth;
+using your_pointcloud_package::test::loadPoint;
+using your_pointcloud_package::test::makeCloud;
+using your_pointcloud_package::test::sceneTofPoints;
+using your_pointcloud_package::test::tofToHires;
+
+CameraProjection tofProjection() {
+    CameraProjection projection;
+    projection.set(756.3f, 752.0f, 512.0f, 384.0f, 1000.0f, tofToHires());
+    return projection;
+}
+
+// Around the target with a margin of wall
+constexpr BoundingBox kTargetBox{205.0f, 130.0f, 815.0f, 640.0f};
+
+/**
+ * @brief The points gateAndAccumulate should keep, back projected into the hires frame
+ *
+ */
+std::vector<Eigen::Vector3f> naiveGate(const Cloud& cloud, const CameraProjection& projection,
+                                       const BoundingBox& box, const TofGate* gate) {
+    std::vector<Eigen::Vector3f> gated;
+    for (size_t row = 0; row < cloud.layout.height; ++row) {
+        for (size_t col = 0; col < cloud.layout.width; ++col) {
+            const Eigen::Vector3f p = loadPoint(cloud, row, col);
+            if (!(isFiniteBits(p.x()) && isFiniteBits(p.y()) && isFiniteBits(p.z()))) {
+                continue;
+            }
+            if (gate != nullptr && (p.z() < gate->z_min || p.z() > gate->z_max)) {
+                continue;
+            }
+            const ProjectedPoint q = projection.project(p.x(), p.y(), p.z());
+            if (q.depth > 0.0f && q.u > box.x_min && q.u < box.x_max && q.v > box.y_min && q.v < box.y_max) {
+                gated.push_back(projection.backProject(q.u, q.v, q.depth));
+            }
+        }
+    }
+    return gated;
+}
+
+void expectMoments(const GateMoments& moments, const std::vector<Eigen::Vector3f>& points) {
+    ASSERT_EQ(moments.count, points.size());
+    if (points.empty()) {
+        return;
+    }
+    Eigen::Vector3d mean = Eigen::Vector3d::Zero();
+    for (const Eigen::Vector3f& p : points) {
+        mean += p.cast<double>();
+    }
+    mean /= static_cast<double>(points.size());
+    Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero();
+    for (const Eigen::Vector3f& p : points) {
+        const Eigen::Vector3d d = p.cast<double>() - mean;
+        covariance += d * d.transpose();
+    }
+    covariance /= static_cast<double>(points.size());
+    EXPECT_LT((moments.centroid().cast<double>() - mean).cwiseAbs().maxCoeff(), 0.05);
+    EXPECT_LT((moments.covariance().cast<double>() - covariance).cwiseAbs().maxCoeff(),
+              0.5 + 1e-4 * covariance.cwiseAbs().maxCoeff());
+}
+
+void expectPoints(const GatedPoints& gated, const std::vector<Eigen::Vector3f>& points) {
+    ASSERT_EQ(gated.size, points.size());
+    EXPECT_EQ(gated.dropped, 0u);
+    for (size_t i = 0; i < points.size(); ++i) {
+        EXPECT_LT((gated.points[i] - points[i]).cwiseAbs().maxCoeff(), 0.01f) << "point " << i;
+    }
+}
+
+void expectHistogram(const DepthHistogram& histogram, const std::vector<Eigen::Vector3f>& points) {
+    DepthHistogram expected;
+    expected.configure(histogram.z_min, histogram.z_min + histogram.bin_width * kDepthBins);
+    for (const Eigen::Vector3f& p : points) {
+        expected.add(p.x(), p.y(), p.z());
+    }
+    for (int bin = 0; bin < kDepthBins; ++bin) {
+        ASSERT_EQ(histogram.count[bin], expected.count[bin]) << "bin " << bin;
+        EXPECT_NEAR(histogram.sz[bin], expected.sz[bin], 1e-3f * std::abs(expected.sz[bin]) + 0.01f);
+    }
+}
+
+int depthBin(const DepthHistogram& histogram, float z) {
+    return std::min(std::max(static_cast<int>((z - histogram.z_min) * histogram.inv_bin_width), 0), kDepthBins - 1);
+}
+
+/**
+ * @brief Brute force over the points: the three neighbouring bins holding the most
+ * points, their mean
+ *
+ */
+Eigen::Vector3f naiveMode(const DepthHistogram& histogram, const std::vector<Eigen::Vector3f>& points) {
+    int best = 0;
+    size_t best_count = 0;
+    for (int bin = 0; bin < kDepthBins; ++bin) {
+        size_t count = 0;
+        for (const Eigen::Vector3f& p : points) {
+            count += std::abs(depthBin(histogram, p.z()) - bin) <= 1;
+        }
+        if (count > best_count) {
+            best_count = count;
+            best = bin;
+        }
+    }
+    Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+    for (const Eigen::Vector3f& p : points) {
+        if (std::abs(depthBin(histogram, p.z()) - best) <= 1) {
+            sum += p.cast<double>();
+        }
+    }
+    return (sum / static_cast<double>(std::max<size_t>(best_count, 1))).cast<float>();
+}
+
+std::vector<float> sortedDepths(const std::vector<Eigen::Vector3f>& points) {
+    std::vector<float> depths;
+    for (const Eigen::Vector3f& p : points) {
+        depths.push_back(p.z());
+    }
+    std::sort(depths.begin(), depths.end());
+    return depths;
+}
+
+}  // namespace
+
+TEST(GateAndAccumulate, MatchesNaiveGateOnEveryLayout) {
+    const CameraProjection projection = tofProjection();
+    const TofGate gate;
+    for (Placement placement : kPlacements) {
+        const Cloud cloud = makeCloud(sceneTofPoints(), kSceneWidth, placement);
+        for (const TofGate* tof_gate : {&gate, static_cast<const TofGate*>(nullptr)}) {
+            const std::vector<Eigen::Vector3f> expected = naiveGate(cloud, projection, kTargetBox, tof_gate);
+            ASSERT_GT(expected.size(), 100u);
+            GateMoments moments;
+            moments.reference = Eigen::Vector3d(0.0, 0.0, 900.0);
+            DepthHistogram histogram;
+            GatedPoints points;
+            points.reserve(cloud.layout.size());
+            gateAndAccumulate(cloud.data.data(), cloud.layout, projection, kTargetBox, tof_gate, moments, &histogram,
+                              &points);
+            expectMoments(moments, expected);
+            expectHistogram(histogram, expected);
+            expectPoints(points, expected);
+        }
+    }
+}
+
+TEST(GateAndAccumulate, EmptyBox) {
+    const CameraProjection projection = tofProjection();
+    const TofGate gate;
+    const Cloud cloud = makeCloud(sceneTofPoints(), kSceneWidth, Placement::kPacked12);
+    for (const BoundingBox& box : {BoundingBox{500.0f, 400.0f, 500.0f, 400.0f},
+                                   BoundingBox{2000.0f, 2000.0f, 2100.0f, 2100.0f}}) {
+        GateMoments moments;
+        DepthHistogram histogram;
+        GatedPoints points;
+        points.reserve(cloud.layout.size());
+        gateAndAccumulate(cloud.data.data(), cloud.layout, projection, box, &gate, moments, &histogram, &points);
+        EXPECT_EQ(moments.count, 0u);
+        EXPECT_EQ(points.size, 0u);
+        for (int bin = 0; bin < kDepthBins; ++bin) {
+            EXPECT_EQ(histogram.count[bin], 0u);
+        }
+        EXPECT_EQ(estimateMode(histogram), Eigen::Vector3f::Zero());
+        EXPECT_EQ(estimateMedian(histogram, 0), Eigen::Vector3f::Zero());
+        EXPECT_EQ(estimateTrimmedMean(histogram, 0, 0.1f), Eigen::Vector3f::Zero());
+    }
+}
+
+TEST(GateAndAccumulate, OnePoint) {
+    const CameraProjection projection = tofProjection();
+    const TofGate gate;
+    for (Placement placement : kPlacements) {
+        const Cloud cloud = makeCloud({Eigen::Vector3f(0.01f, -0.02f, 0.9f)}, 1, placement);
+        const std::vector<Eigen::Vector3f> expected = naiveGate(cloud, projection, kTargetBox, &gate);
+        ASSERT_EQ(expected.size(), 1u);
+        // Near the point like the nodes place it, the float sums cancel otherwise
+        GateMoments moments;
+        moments.reference = Eigen::Vector3d(10.0, -20.0, 905.0);
+        GatedPoints points;
+        points.reserve(1);
+        gateAndAccumulate(cloud.data.data(), cloud.layout, projection, kTargetBox, &gate, moments, nullptr, &points);
+        expectMoments(moments, expected);
+        expectPoints(points, expected);
+        EXPECT_LT(moments.covariance().cwiseAbs().maxCoeff(), 1e-3f);
+    }
+}
+
+TEST(GateAndAccumulateMulti, MatchesNaiveGatePerBox) {
+    const CameraProjection projection = tofProjection();
+    const TofGate gate;
+    const BoundingBox boxes[] = {kTargetBox, BoundingBox{600.0f, 300.0f, 1000.0f, 700.0f},
+                                 BoundingBox{0.0f, 0.0f, 300.0f, 250.0f}, BoundingBox{500.0f, 400.0f, 500.0f, 400.0f}};
+    constexpr size_t kBoxes = sizeof(boxes) / sizeof(boxes[0]);
+    TiledBoxIndex index;
+    index.resize(1024, 768, 32);
+    index.build(boxes, kBoxes);
+    for (Placement placement : kPlacements) {
+        const Cloud cloud = makeCloud(sceneTofPoints(), kSceneWidth, placement);
+        GateMoments moments[kBoxes];
+        DepthHistogram histograms[kBoxes];
+        GatedPoints points[kBoxes];
+        for (size_t i = 0; i < kBoxes; ++i) {
+            moments[i].reference = Eigen::Vector3d(0.0, 0.0, 1000.0);
+            points[i].reserve(cloud.layout.size());
+        }
+        gateAndAccumulateMulti(cloud.data.data(), cloud.layout, projection, boxes, kBoxes, index, &gate, moments,
+                               histograms, points);
+        for (size_t i = 0; i < kBoxes; ++i) {
+            SCOPED_TRACE(i);
+            const std::vector<Eigen::Vector3f> expected = naiveGate(cloud, projection, boxes[i], &gate);
+            expectMoments(moments[i], expected);
+            expectHistogram(histograms[i], expected);
+            expectPoints(points[i], expected);
+        }
+    }
+}
+
+TEST(DepthEstimator, MatchesNaiveEstimatesOfTheGatedPoints) {
+    const CameraProjection projection = tofProjection();
+    const TofGate gate;
+    const Cloud cloud = makeCloud(sceneTofPoints(), kSceneWidth, Placement::kPacked16);
+    const std::vector<Eigen::Vector3f> expected = naiveGate(cloud, projection, kTargetBox, &gate);
+    GateMoments moments;
+    DepthHistogram histogram;
+    gateAndAccumulate(cloud.data.data(), cloud.layout, projection, kTargetBox, &gate, moments, &histogram);
+    ASSERT_EQ(moments.count, expected.size());
+
+    EXPECT_LT((estimateMode(histogram) - naiveMode(histogram, expected)).cwiseAbs().maxCoeff(), 0.05f);
+
+    // The median depth is interpolated inside its bin, x and y follow the ray of the
+    // mean of that bin
+    const std::vector<float> depths = sortedDepths(expected);
+    const Eigen::Vector3f median = estimateMedian(histogram, moments.count);
+    EXPECT_NEAR(median.z(), depths[depths.size() / 2], histogram.bin_width);
+    Eigen::Vector3d bin_sum = Eigen::Vector3d::Zero();
+    for (const Eigen::Vector3f& p : expected) {
+        if (depthBin(histogram, p.z()) == depthBin(histogram, median.z())) {
+            bin_sum += p.cast<double>();
+        }
+    }
+    EXPECT_NEAR(median.x() / median.z(), bin_sum.x() / bin_sum.z(), 1e-4);
+    EXPECT_NEAR(median.y() / median.z(), bin_sum.y() / bin_sum.z(), 1e-4);
+
+    const float trim = 0.2f;
+    const size_t cut = static_cast<size_t>(trim * depths.size());
+    double trimmed_z = 0.0;
+    for (size_t i = cut; i < depths.size() - cut; ++i) {
+        trimmed_z += depths[i];
+    }
+    trimmed_z /= static_cast<double>(depths.size() - 2 * cut);
+    EXPECT_NEAR(estimateTrimmedMean(histogram, moments.count, trim).z(), trimmed_z, histogram.bin_width);
+}
+
+TEST(DepthEstimator, TrimmedMeanIsExactOnWholePoints) {
+    // Every bin holds copies of one point and the quantiles fall between points, so the
+    // fractions of the straddling bins are whole points
+    DepthHistogram histogram;
+    std::vector<Eigen::Vector3f> points;
+    const Eigen::Vector3f surfaces[] = {{-40.0f, 10.0f, 412.5f}, {15.0f, -5.0f, 812.5f}, {60.0f, 30.0f, 1212.5f}};
+    const size_t copies[] = {30, 120, 50};
+    for (size_t s = 0; s < 3; ++s) {
+        for (size_t i = 0; i < copies[s]; ++i) {
+            points.push_back(surfaces[s]);
+            histogram.add(surfaces[s].x(), surfaces[s].y(), surfaces[s].z());
+        }
+    }
+    const float trim = 0.25f;
+    std::vector<Eigen::Vector3f> sorted = points;
+    std::sort(sorted.begin(), sorted.end(),
+              [](const Eigen::Vector3f& a, const Eigen::Vector3f& b) { return a.z() < b.z(); });
+    const size_t cut = static_cast<size_t>(trim * sorted.size());
+    Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+    for (size_t i = cut; i < sorted.size() - cut; ++i) {
+        sum += sorted[i].cast<double>();
+    }
+    const Eigen::Vector3f expected = (sum / static_cast<double>(sorted.size() - 2 * cut)).cast<float>();
+    EXPECT_LT((estimateTrimmedMean(histogram, points.size(), trim) - expected).cwiseAbs().maxCoeff(), 1e-3f);
+    EXPECT_LT((estimateMode(histogram) - surfaces[1]).cwiseAbs().maxCoeff(), 1e-3f);
+}
+
+namespace {
+
+/**
+ * @brief Detection whose every field is derived from k, so a torn copy is detectable
+ *
+ */
+TimedDetection numberedDetection(int64_t k) {
+    TimedDetection detection{};
+    detection.stamp_ns = k;
+    detection.class_id = static_cast<uint32_t>(k * 7);
+    detection.confidence = static_cast<float>(k % 1000);
+    const float x = static_cast<float>(k % 4096);
+    detection.box = BoundingBox{x, x + 1.0f, x + 2.0f, x + 3.0f};
+    std::snprintf(detection.class_name, sizeof(detection.class_name), "d%lld", static_cast<long long>(k));
+    return detection;
+}
+
+bool consistent(const TimedDetection& detection) {
+    const TimedDetection expected = numberedDetection(detection.stamp_ns);
+    return std::memcmp(&detection, &expected, sizeof(TimedDetection)) == 0;
+}
+
+TimedDetection detectionAt(int64_t stamp_ms, uint32_t class_id, float confidence, const BoundingBox& box) {
+    TimedDetection detection{};
+    detection.stamp_ns = stamp_ms * 1000000;
+    detection.class_id = class_id;
+    detection.confidence = confidence;
+    detection.box = box;
+    return detection;
+}
+
+void expectBox(const BoundingBox& box, const BoundingBox& expected) {
+    EXPECT_NEAR(box.x_min, expected.x_min, 1e-3f);
+    EXPECT_NEAR(box.y_min, expected.y_min, 1e-3f);
+    EXPECT_NEAR(box.x_max, expected.x_max, 1e-3f);
+    EXPECT_NEAR(box.y_max, expected.y_max, 1e-3f);
+}
+
+}  // namespace
+
+TEST(SpscRing, KeepsTheNewestEntriesNewestFirst) {
+    SpscRing<TimedDetection, 8> ring;
+    std::deque<TimedDetection> expected;
+    TimedDetection out[16];
+    EXPECT_EQ(ring.snapshot(out, 16), 0u);
+    for (int64_t k = 1; k <= 21; ++k) {
+        ring.push(numberedDetection(k));
+        expected.push_front(numberedDetection(k));
+        if (expected.size() > ring.capacity()) {
+            expected.pop_back();
+        }
+        const size_t n = ring.snapshot(out, 16);
+        ASSERT_EQ(n, expected.size());
+        for (size_t i = 0; i < n; ++i) {
+            EXPECT_EQ(std::memcmp(&out[i], &expected[i], sizeof(TimedDetection)), 0) << "entry " << i;
+        }
+        ASSERT_EQ(ring.snapshot(out, 3), std::min<size_t>(3, expected.size()));
+        EXPECT_EQ(out[0].stamp_ns, k);
+    }
+}
+
+TEST(SpscRing, ReaderNeverSeesTornEntriesWhileOverwritten) {
+    SpscRing<TimedDetection, 8> ring;
+    constexpr int64_t kPushes = 200000;
+    std::atomic<bool> done{false};
+    std::thread producer([&ring, &done]() {
+        for (int64_t k = 1; k <= kPushes; ++k) {
+            ring.push(numberedDetection(k));
+        }
+        done.store(true, std::memory_order_release);
+    });
+    TimedDetection out[8];
+    size_t torn = 0;
+    size_t misplaced = 0;
+    size_t snapshots = 0;
+    while (!done.load(std::memory_order_acquire)) {
+        const size_t n = ring.snapshot(out, 8);
+        for (size_t i = 0; i < n; ++i) {
+            torn += !consistent(out[i]);
+            // An entry overwritten during the snapshot is newer, but still from its slot
+            if (i > 0 && ((out[i - 1].stamp_ns - out[i].stamp_ns) & 7) != 1) {
+                ++misplaced;
+            }
+        }
+        ++snapshots;
+    }
+    producer.join();
+    EXPECT_EQ(torn, 0u) << "in " << snapshots << " snapshots";
+    EXPECT_EQ(misplaced, 0u);
+    ASSERT_EQ(ring.snapshot(out, 8), 8u);
+    for (size_t i = 0; i < 8; ++i) {
+        EXPECT_EQ(out[i].stamp_ns, kPushes - static_cast<int64_t>(i));
+        EXPECT_TRUE(consistent(out[i]));
+    }
+}
+
+TEST(AssociateDetections, PairsClosestDetectionsAndInterpolates) {
+    const BoundingBox a_box{100.0f, 100.0f, 200.0f, 200.0f};
+    const BoundingBox b_box{110.0f, 104.0f, 210.0f, 204.0f};
+    const TimedDetection recent[] = {
+        detectionAt(80, 0, 0.9f, a_box),                                      // object 0, before the frame
+        detectionAt(170, 0, 0.9f, a_box),                                     // beyond the skew
+        detectionAt(130, 0, 0.8f, b_box),                                     // object 0, after the frame
+        detectionAt(95, 0, 0.7f, BoundingBox{500.0f, 500.0f, 560.0f, 560.0f}),  // object 1, same class
+        detectionAt(102, 1, 0.6f, a_box),                                     // object 2, other class
+        detectionAt(99, 0, 0.0f, a_box),                                      // no confidence
+        detectionAt(60, 0, 0.9f, BoundingBox{102.0f, 100.0f, 202.0f, 200.0f}),  // object 0, before again
+    };
+    constexpr size_t kRecent = sizeof(recent) / sizeof(recent[0]);
+    const int64_t stamp_ns = 100 * 1000000;
+    TimedDetection out[kMaxDetections];
+    const size_t n = associateDetections<16>(recent, kRecent, stamp_ns, 60 * 1000000, 0.3f, out, kMaxDetections);
+    // Objects come in the order of their closest detection
+    ASSERT_EQ(n, 3u);
+    for (size_t i = 0; i < n; ++i) {
+        EXPECT_EQ(out[i].stamp_ns, stamp_ns);
+    }
+    EXPECT_EQ(out[0].class_id, 1u);
+    expectBox(out[0].box, a_box);
+    EXPECT_EQ(out[1].class_id, 0u);
+    expectBox(out[1].box, BoundingBox{500.0f, 500.0f, 560.0f, 560.0f});
+    // 80 ms and 130 ms around the frame at 100 ms
+    EXPECT_EQ(out[2].class_id, 0u);
+    EXPECT_FLOAT_EQ(out[2].confidence, 0.9f);
+    expectBox(out[2].box, BoundingBox{104.0f, 101.6f, 204.0f, 201.6f});
+
+    ASSERT_EQ(associateDetections<16>(recent, kRecent, stamp_ns, 60 * 1000000, 0.3f, out, 2), 2u);
+    EXPECT_EQ(out[1].class_id, 0u);
+    EXPECT_EQ(associateDetections<16>(recent, kRecent, 400 * 1000000, 60 * 1000000, 0.3f, out, kMaxDetections), 0u);
+
+    const TimedDetection single = detectionAt(100, 3, 0.5f, b_box);
+    ASSERT_EQ(associateDetections<16>(&single, 1, stamp_ns, 60 * 1000000, 0.3f, out, kMaxDetections), 1u);
+    expectBox(out[0].box, b_box);
+}
+
+namespace {
+
+GateMoments momentsOf(const std::vector<Eigen::Vector3f>& points, const Eigen::Vector3d& reference) {
+    GateMoments moments;
+    moments.reference = reference;
+    for (const Eigen::Vector3f& p : points) {
+        const Eigen::Vector3d centered = p.cast<double>() - reference;
+        ++moments.count;
+        moments.sum += centered;
+        moments.sum_sq += centered * centered.transpose();
+    }
+    return moments;
+}
+
+}  // namespace
+
+TEST(TemporalMoments, MatchesTheMomentsOfTheWindowPoints) {
+    constexpr size_t kLength = 4;
+    constexpr int64_t kMaxAgeNs = 100000000;
+    TemporalMoments<8> window;
+    window.configure(kLength, kMaxAgeNs);
+    struct Frame {
+        int64_t stamp_ns;
+        Eigen::Isometry3d camera_to_odom;
+        std::vector<Eigen::Vector3f> points;
+    };
+    std::vector<Frame> frames;
+    // 30 Hz with a gap after the sixth frame that empties the window, frame 3 is empty
+    const int64_t stamps_ms[] = {0, 33, 66, 99, 132, 165, 1000, 1033, 1066};
+    for (size_t k = 0; k < sizeof(stamps_ms) / sizeof(stamps_ms[0]); ++k) {
+        Frame frame;
+        frame.stamp_ns = stamps_ms[k] * 1000000;
+        frame.camera_to_odom.setIdentity();
+        frame.camera_to_odom.linear() =
+            Eigen::AngleAxisd(0.05 * k, Eigen::Vector3d(0.2, 1.0, 0.1).normalized()).toRotationMatrix();
+        frame.camera_to_odom.translation() = Eigen::Vector3d(120.0 * k, -40.0 * k, 15.0 * k);
+        if (k != 3) {
+            frame.points = blob(Eigen::Vector3f(50.0f - 10.0f * k, -20.0f, 900.0f - 25.0f * k), 30.0f, 5 + k % 3,
+                                static_cast<uint32_t>(k + 1));
+        }
+        window.add(momentsOf(frame.points, Eigen::Vector3d(10.0 * k, 0.0, 880.0)), frame.camera_to_odom,
+                   frame.stamp_ns);
+        frames.push_back(frame);
+
+        std::vector<Eigen::Vector3f> expected;
+        size_t expected_frames = 0;
+        const Eigen::Isometry3d odom_to_camera = frame.camera_to_odom.inverse();
+        for (size_t j = 0; j <= k; ++j) {
+            if (k - j >= kLength || frame.stamp_ns - frames[j].stamp_ns > kMaxAgeNs) {
+                continue;
+            }
+            ++expected_frames;
+            for (const Eigen::Vector3f& p : frames[j].points) {
+                expected.push_back((odom_to_camera * (frames[j].camera_to_odom * p.cast<double>())).cast<float>());
+            }
+        }
+        SCOPED_TRACE(k);
+        EXPECT_EQ(window.frames(), expected_frames);
+        EXPECT_EQ(window.count(), expected.size());
+        expectMoments(window.moments(frame.camera_to_odom), expected);
+    }
+}
+
+namespace {
+
+/**
+ * @brief Flood fill over every pair of points, clusters labelled in the order of their
+ * lowest point index
+ *
+ */
+std::vector<int32_t> naiveClusterLabels(const std::vector<Eigen::Vector3f>& points, float tolerance) {
+    std::vector<int32_t> labels(points.size(), -1);
+    int32_t next_label = 0;
+    for (size_t seed = 0; seed < points.size(); ++seed) {
+        if (labels[seed] >= 0) {
+            continue;
+        }
+        std::vector<size_t> stack{seed};
+        labels[seed] = next_label;
+        while (!stack.empty()) {
+            const size_t i = stack.back();
+            stack.pop_back();
+            for (size_t j = 0; j < points.size(); ++j) {
+                if (labels[j] < 0 && (points[j] - points[i]).squaredNorm() <= tolerance * tolerance) {
+                    labels[j] = next_label;
+                    stack.push_back(j);
+                }
+            }
+        }
+        ++next_label;
+    }
+    return labels;
+}
+
+/**
+ * @brief Scene of two blobs, a chain longer than a cell and a few isolated points,
+ * interleaved so the seeds of the flood fill alternate between them
+ *
+ */
+std::vector<Eigen::Vector3f> clusterScene(uint32_t seed) {
+    std::vector<Eigen::Vector3f> ordered = blob(Eigen::Vector3f(0.0f, 0.0f, 800.0f), 20.0f, 30, seed);
+    const std::vector<Eigen::Vector3f> far_blob = blob(Eigen::Vector3f(300.0f, 50.0f, 1200.0f), 25.0f, 20, seed + 1);
+    ordered.insert(ordered.end(), far_blob.begin(), far_blob.end());
+    for (int i = 0; i < 15; ++i) {
+        ordered.emplace_back(-500.0f + 40.0f * i, 3.0f * (i % 2), 1000.0f);
+    }
+    for (int i = 0; i < 5; ++i) {
+        ordered.emplace_back(-900.0f + 400.0f * i, 600.0f, 1500.0f + 17.0f * seed);
+    }
+    std::vector<Eigen::Vector3f> points;
+    for (size_t i = 0; i < ordered.size(); ++i) {
+        points.push_back(ordered[(i * 7) % ordered.size()]);
+    }
+    return points;
+}
+
+void expectClusters(ClusterGrid& grid, const std::vector<Eigen::Vector3f>& points, float tolerance) {
+    const std::vector<int32_t> expected = naiveClusterLabels(points, tolerance);
+    const int32_t n_expected = expected.empty() ? 0 : *std::max_element(expected.begin(), expected.end()) + 1;
+    ASSERT_EQ(grid.cluster(points.data(), points.size(), tolerance), static_cast<size_t>(n_expected));
+    for (size_t i = 0; i < points.size(); ++i) {
+        ASSERT_EQ(grid.label(i), expected[i]) << "point " << i;
+    }
+    for (int32_t c = 0; c < n_expected; ++c) {
+        Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+        size_t count = 0;
+        for (size_t i = 0; i < points.size(); ++i) {
+            if (expected[i] == c) {
+                sum += points[i].cast<double>();
+                ++count;
+            }
+        }
+        const Eigen::Vector3d mean = sum / static_cast<double>(count);
+        double sum_sq = 0.0;
+        for (size_t i = 0; i < points.size(); ++i) {
+            if (expected[i] == c) {
+                sum_sq += (points[i].cast<double>() - mean).squaredNorm();
+            }
+        }
+        const PointCluster& cluster = grid.cluster(c);
+        EXPECT_EQ(cluster.count, count);
+        EXPECT_LT((cluster.centroid.cast<double>() - mean).cwiseAbs().maxCoeff(), 1e-3);
+        EXPECT_NEAR(cluster.radius, std::sqrt(sum_sq / static_cast<double>(count)), 1e-2);
+    }
+}
+
+}  // namespace
+
+TEST(ClusterGrid, MatchesNaiveFloodFill) {
+    ClusterGrid grid(256);
+    const std::vector<Eigen::Vector3f> points = clusterScene(1);
+    expectClusters(grid, points, 50.0f);
+    expectClusters(grid, points, 10.0f);
+    expectClusters(grid, points, 200.0f);
+}
+
+TEST(ClusterGrid, EdgeCases) {
+    ClusterGrid grid;
+    expectClusters(grid, {}, 50.0f);
+    expectClusters(grid, {Eigen::Vector3f(12.0f, -3.0f, 700.0f)}, 50.0f);
+    // All points in one cell, close enough to be one cluster
+    expectClusters(grid, blob(Eigen::Vector3f(25.0f, 25.0f, 725.0f), 10.0f, 40, 9), 50.0f);
+    EXPECT_EQ(grid.clusters(), 1u);
+}
+
+TEST(ClusterGrid, GenerationWrap) {
+    ClusterGrid grid(256);
+    const std::vector<Eigen::Vector3f> first = clusterScene(1);
+    const std::vector<Eigen::Vector3f> second = clusterScene(2);
+    expectClusters(grid, first, 50.0f);
+    // The next call runs at the last generation, the one after wraps to 0
+    grid.startGeneration(std::numeric_limits<uint32_t>::max() - 1);
+    expectClusters(grid, second, 50.0f);
+    expectClusters(grid, first, 50.0f);
+    expectClusters(grid, second, 50.0f);
+}
+
+}  // namespace tflite_prop_detection
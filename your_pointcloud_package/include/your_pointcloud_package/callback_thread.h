@@ -0,0 +1,100 @@
+/**
+ * @file callback_thread.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief A ROS callback queue served by its own thread, optionally pinned to one core, so
+ * a slow subscription cannot hold up the others
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef YOUR_POINTCLOUD_PACKAGE_CALLBACK_THREAD_H
+#define YOUR_POINTCLOUD_PACKAGE_CALLBACK_THREAD_H
+
+#include <your_pointcloud_package/cpu_affinity.h>
+#include <ros/callback_queue.h>
+#include <ros/ros.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace your_pointcloud_package {
+
+/**
+ * @brief Subscriptions made through nodeHandle() run their callbacks on this thread, one
+ * at a time and in arrival order
+ *
+ */
+class CallbackThread {
+public:
+    /**
+     * @param nh Handle whose namespace the returned node handle inherits
+     * @param name Used in the log messages
+     * @param cpu_index Core like the CPUS enum (1 = CPU1), 0 leaves the thread unpinned
+     */
+    CallbackThread(const ros::NodeHandle& nh, const std::string& name, int cpu_index)
+        : nh_(nh), name_(name), running_(true), pinned_(false) {
+        nh_.setCallbackQueue(&queue_);
+        thread_ = std::thread(&CallbackThread::spin, this, cpu_index);
+    }
+
+    ~CallbackThread() { stop(); }
+
+    CallbackThread(const CallbackThread&) = delete;
+    CallbackThread& operator=(const CallbackThread&) = delete;
+
+    /**
+     * @brief Node handle bound to the queue of this thread
+     *
+     */
+    ros::NodeHandle& nodeHandle() { return nh_; }
+
+    /**
+     * @brief Lets the callback that is running finish and joins the thread, the queued
+     * callbacks are dropped. Shut the subscriptions down afterwards, not before.
+     *
+     */
+    void stop() {
+        running_.store(false, std::memory_order_relaxed);
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    bool pinned() const { return pinned_.load(std::memory_order_relaxed); }
+
+private:
+    void spin(int cpu_index) {
+        if (cpu_index != 0) {
+            CPUS cpu;
+            try {
+                if (!cpuFromIndex(cpu_index, cpu)) {
+                    throw std::runtime_error("Invalid core number " + std::to_string(cpu_index));
+                }
+                applyAffinity(cpu);
+                pinned_.store(true, std::memory_order_relaxed);
+            } catch (const std::runtime_error& e) {
+                ROS_WARN("%s thread could not be pinned to CPU%d: %s", name_.c_str(), cpu_index, e.what());
+            }
+        }
+        // The timeout only bounds how long stop() waits on an idle queue
+        while (running_.load(std::memory_order_relaxed) && nh_.ok()) {
+            queue_.callAvailable(ros::WallDuration(0.1));
+        }
+    }
+
+    ros::CallbackQueue queue_;
+    ros::NodeHandle nh_;
+    std::string name_;
+    std::atomic<bool> running_;
+    std::atomic<bool> pinned_;
+    std::thread thread_;
+};
+
+}  // namespace your_pointcloud_package
+
+#endif  // YOUR_POINTCLOUD_PACKAGE_CALLBACK_THREAD_H
@@ -0,0 +1,251 @@
+/**
+ * @file cloud_downsample.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Optional downsampling of the ToF cloud: a stride view over the organized input
+ * and a voxel grid over the filtered output, both capped by a point budget
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef YOUR_POINTCLOUD_PACKAGE_CLOUD_DOWNSAMPLE_H
+#define YOUR_POINTCLOUD_PACKAGE_CLOUD_DOWNSAMPLE_H
+
+#include <your_pointcloud_package/tof_filter_transform.h>
+
+#include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace your_pointcloud_package {
+
+enum class DownsampleMode {
+    kNone,
+    kStride,
+    kVoxel,
+};
+
+inline const char* downsampleModeName(DownsampleMode mode) {
+    switch (mode) {
+        case DownsampleMode::kStride: return "stride";
+        case DownsampleMode::kVoxel: return "voxel";
+        default: return "none";
+    }
+}
+
+/**
+ * @brief Parses "none", "stride" or "voxel"
+ *
+ * @return bool False if the name is unknown, mode is left untouched
+ */
+inline bool parseDownsampleMode(const std::string& name, DownsampleMode& mode) {
+    for (DownsampleMode m : {DownsampleMode::kNone, DownsampleMode::kStride, DownsampleMode::kVoxel}) {
+        if (name == downsampleModeName(m)) {
+            mode = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Layout that only visits every stride-th column of every stride-th row. The
+ * filter kernel walks it like any other cloud, so the skipped points are never read.
+ *
+ */
+inline CloudLayout stridedLayout(const CloudLayout& layout, uint32_t stride) {
+    if (stride <= 1) {
+        return layout;
+    }
+    CloudLayout strided = layout;
+    strided.point_step = layout.point_step * stride;
+    strided.row_step = layout.row_step * stride;
+    strided.width = (layout.width + stride - 1) / stride;
+    strided.height = (layout.height + stride - 1) / stride;
+    return strided;
+}
+
+/**
+ * @brief Smallest stride at or above min_stride whose strided cloud fits in max_points,
+ * 0 means no budget
+ *
+ */
+inline uint32_t strideForBudget(const CloudLayout& layout, uint32_t min_stride, size_t max_points) {
+    uint32_t stride = std::max(min_stride, 1u);
+    if (max_points == 0) {
+        return stride;
+    }
+    while (stride < std::max(layout.width, layout.height) && stridedLayout(layout, stride).size() > max_points) {
+        ++stride;
+    }
+    return stride;
+}
+
+/**
+ * @brief Keeps max_points evenly spaced points of the n packed kernel output points, in
+ * place. Last resort when a frame is still over budget after downsampling.
+ *
+ * @return size_t Number of points kept
+ */
+inline size_t thinPoints(uint8_t* points, size_t n, size_t max_points) {
+    if (max_points == 0 || n <= max_points) {
+        return n;
+    }
+    for (size_t k = 0; k < max_points; ++k) {
+        const size_t src = k * n / max_points;
+        if (src != k) {
+            std::memcpy(points + k * kOutputPointStep, points + src * kOutputPointStep, kOutputPointStep);
+        }
+    }
+    return max_points;
+}
+
+/**
+ * @brief Voxel grid on a fixed capacity open addressing table. Every occupied voxel is
+ * replaced by the centroid of its points, in the order the voxels were first hit. A
+ * table entry packs the voxel key and the index of the voxel in a dense array of sums
+ * into 8 bytes, so a lookup touches one cache line and the sums are written in
+ * scanline order. Memory is allocated once, only the entries used by a frame are
+ * cleared after it, so a frame neither allocates nor touches the whole table.
+ *
+ */
+class VoxelGrid {
+public:
+    // The voxel index lives in 16 bits of a table entry
+    static constexpr size_t kMaxPoints = 65535;
+
+    /**
+     * @param max_points Largest number of points passed to one downsample call, at most
+     * kMaxPoints. The table gets at least twice as many entries.
+     */
+    explicit VoxelGrid(size_t max_points) {
+        max_points_ = std::min(std::max<size_t>(max_points, 1), kMaxPoints);
+        capacity_ = 1;
+        while (capacity_ < 2 * max_points_) {
+            capacity_ <<= 1;
+        }
+        mask_ = capacity_ - 1;
+        table_.reset(new uint64_t[capacity_]);
+        std::fill(table_.get(), table_.get() + capacity_, kEmpty);
+        sums_.reset(new Eigen::Vector4f[max_points_]);
+        slots_.reset(new uint32_t[max_points_]);
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    /**
+     * @brief Downsamples n packed kernel output points in place. The padding lane of the
+     * kernel output is 1, so summing whole packets counts the points of a voxel for free.
+     *
+     * @param points Packed points with kOutputPointStep stride
+     * @param n Number of points, anything past max_points is dropped
+     * @param leaf Voxel edge length, in the units of the points. Coordinates must stay
+     * within 32767 leaves of the origin.
+     * @return size_t Number of voxel centroids written to the front of points
+     */
+    size_t downsample(uint8_t* points, size_t n, float leaf) {
+        n = std::min(n, max_points_);
+        const float inv_leaf = 1.0f / leaf;
+        size_t n_voxels = 0;
+        uint64_t last_key = kEmpty;
+        size_t last_voxel = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const Eigen::Map<const Eigen::Vector4f> p(reinterpret_cast<const float*>(points + i * kOutputPointStep));
+            const uint64_t key = voxelKey(p(0) * inv_leaf, p(1) * inv_leaf, p(2) * inv_leaf);
+            // Neighbouring pixels of an organized cloud mostly share a voxel
+            if (key != last_key) {
+                last_key = key;
+                last_voxel = findOrInsert(key, n_voxels);
+                if (last_voxel == n_voxels) {
+                    sums_[n_voxels++] = p;
+                    continue;
+                }
+            }
+            sums_[last_voxel] += p;
+        }
+        for (size_t k = 0; k < n_voxels; ++k) {
+            const Eigen::Vector4f& sum = sums_[k];
+            Eigen::Map<Eigen::Vector4f> centroid(reinterpret_cast<float*>(points + k * kOutputPointStep));
+            centroid = sum * (1.0f / sum(3));
+            // Exactly the padding value pcl writes, whatever the rounding of the division
+            centroid(3) = 1.0f;
+            table_[slots_[k]] = kEmpty;
+        }
+        return n_voxels;
+    }
+
+private:
+    static constexpr uint64_t kEmpty = ~0ull;
+    static constexpr uint64_t kKeyMask = ~0xffffull;
+
+    /**
+     * @brief Index of the voxel with this key, or next_voxel after inserting it
+     *
+     */
+    size_t findOrInsert(uint64_t key, size_t next_voxel) {
+        size_t slot = static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 40) & mask_;
+        while (table_[slot] != kEmpty) {
+            if ((table_[slot] & kKeyMask) == key) {
+                return static_cast<size_t>(table_[slot] & 0xffffu);
+            }
+            slot = (slot + 1) & mask_;
+        }
+        table_[slot] = key | next_voxel;
+        slots_[next_voxel] = static_cast<uint32_t>(slot);
+        return next_voxel;
+    }
+
+    /**
+     * @brief Packs the three voxel indices into the upper 48 bits, 16 bits each
+     *
+     */
+    static uint64_t voxelKey(float x, float y, float z) {
+        return (voxelIndex(x) << 48) | (voxelIndex(y) << 32) | (voxelIndex(z) << 16);
+    }
+
+    /**
+     * @brief floor without the libm call std::floor turns into when SSE4.1 is off
+     *
+     */
+    static uint64_t voxelIndex(float v) {
+        int32_t i = static_cast<int32_t>(v);
+        i -= static_cast<float>(i) > v;
+        return static_cast<uint64_t>(i + (1 << 15)) & 0xffffu;
+    }
+
+    size_t capacity_;
+    size_t mask_;
+    size_t max_points_;
+    // Voxel key in the upper 48 bits, index into sums_ in the lower 16
+    std::unique_ptr<uint64_t[]> table_;
+    // Point sums of the voxels of the current frame, in first hit order
+    std::unique_ptr<Eigen::Vector4f[]> sums_;
+    // Table entry of every voxel, to clear the table after the frame
+    std::unique_ptr<uint32_t[]> slots_;
+};
+
+/**
+ * @brief Adapts the voxel leaf to a point budget. A ToF cloud is a surface, so the
+ * voxel count falls with the square of the leaf: the leaf is scaled by the square root
+ * of the overshoot for the next frame, never below the configured leaf and never above
+ * max_scale times it.
+ *
+ */
+inline float adaptVoxelLeaf(float leaf, float min_leaf, size_t n_out, size_t max_points, float max_scale = 16.0f) {
+    if (max_points == 0 || n_out == 0) {
+        return leaf;
+    }
+    const float scaled = leaf * std::sqrt(static_cast<float>(n_out) / static_cast<float>(max_points));
+    return std::min(std::max(scaled, min_leaf), min_leaf * max_scale);
+}
+
+}  // namespace your_pointcloud_package
+
+#endif  // YOUR_POINTCLOUD_PACKAGE_CLOUD_DOWNSAMPLE_H
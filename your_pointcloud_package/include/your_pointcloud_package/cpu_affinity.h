@@ -0,0 +1,62 @@
+/**
+ * @file cpu_affinity.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Helpers to pin the calling thread to one of the cores of the flight computer
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef YOUR_POINTCLOUD_PACKAGE_CPU_AFFINITY_H
+#define YOUR_POINTCLOUD_PACKAGE_CPU_AFFINITY_H
+
+#include <sched.h>
+#include <pthread.h>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+
+enum class CPUS:size_t{
+CPU1,
+CPU2,
+CPU3,
+CPU4,
+CPU5,
+CPU6,
+CPU7,
+CPU8
+};
+
+inline std::runtime_error getError(std::string msg,int result){
+    return std::runtime_error(msg+" Reason:"+std::string(std::strerror(result)));
+}
+
+
+inline void applyAffinity(const CPUS affCPU) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    const auto aff = static_cast<std::underlying_type<CPUS>::type>(affCPU);
+    CPU_SET(aff, &cpuset);  
+    auto result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+    if (result != 0) {
+        throw getError("Failed to attach affinity",result);
+    }
+}
+
+/**
+ * @brief Maps the 1 based core number used in the launch files (CPU1 ... CPU8) to CPUS
+ *
+ * @return false if the number is outside CPU1 ... CPU8
+ */
+inline bool cpuFromIndex(int index, CPUS& cpu) {
+    if (index < 1 || index > 8) {
+        return false;
+    }
+    cpu = static_cast<CPUS>(index - 1);
+    return true;
+}
+
+#endif  // YOUR_POINTCLOUD_PACKAGE_CPU_AFFINITY_H
@@ -0,0 +1,121 @@
+/**
+ * @file load_governor.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Keeps the latency of a stage bounded when the CPU is shared with the detector
+ * and VIO. Frames whose stamp is already older than max_age are dropped before any work,
+ * and the mean processing time over a window of frames is held against a deadline: above
+ * it the quality level steps down (a higher level is cheaper), well below it the level
+ * steps back up. What a level means is up to the stage.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef YOUR_POINTCLOUD_PACKAGE_LOAD_GOVERNOR_H
+#define YOUR_POINTCLOUD_PACKAGE_LOAD_GOVERNOR_H
+
+#include <algorithm>
+#include <cstdint>
+
+namespace your_pointcloud_package {
+
+/**
+ * @brief Parameters of the load governor, all under ~governor_*
+ *
+ */
+struct GovernorConfig {
+    // Processing time budget of a frame in seconds, 0 keeps the full quality
+    double deadline = 0.0;
+    // Frames older than this on arrival are dropped, in seconds, 0 keeps every frame
+    double max_age = 0.0;
+    // Cheapest level
+    int max_level = 3;
+    // The level steps up once the mean time stays below headroom * deadline
+    double headroom = 0.6;
+    // Frames the mean time is taken over before the level may change again
+    int window = 10;
+
+    /**
+     * @brief Reads the parameters through params.param(name, value, default), from a
+     * private ros::NodeHandle or anything with the same interface
+     *
+     */
+    template <typename Params>
+    void load(const Params& params) {
+        params.param("governor_deadline", deadline, 0.0);
+        params.param("governor_max_age", max_age, 0.0);
+        params.param("governor_max_level", max_level, 3);
+        params.param("governor_headroom", headroom, 0.6);
+        params.param("governor_window", window, 10);
+        deadline = std::max(deadline, 0.0);
+        max_age = std::max(max_age, 0.0);
+        max_level = std::max(max_level, 0);
+        headroom = std::min(std::max(headroom, 0.0), 1.0);
+        window = std::max(window, 1);
+    }
+};
+
+class LoadGovernor {
+public:
+    explicit LoadGovernor(const GovernorConfig& config = GovernorConfig())
+        : config_(config), deadline_ns_(static_cast<int64_t>(config.deadline * 1e9)),
+          max_age_ns_(static_cast<int64_t>(config.max_age * 1e9)) {}
+
+    /**
+     * @brief Whether a frame that is age_ns old on arrival is not worth processing anymore
+     *
+     */
+    bool stale(int64_t age_ns) const { return max_age_ns_ > 0 && age_ns > max_age_ns_; }
+
+    /**
+     * @brief Adds the processing time of a frame
+     *
+     * @return true if the level changed
+     */
+    bool record(int64_t processing_ns) {
+        if (deadline_ns_ <= 0) {
+            return false;
+        }
+        total_ns_ += processing_ns;
+        if (++frames_ < config_.window) {
+            return false;
+        }
+        const int64_t mean_ns = total_ns_ / frames_;
+        frames_ = 0;
+        total_ns_ = 0;
+        int level = level_;
+        if (mean_ns > deadline_ns_) {
+            level = std::min(level + 1, config_.max_level);
+        } else if (static_cast<double>(mean_ns) < config_.headroom * static_cast<double>(deadline_ns_)) {
+            level = std::max(level - 1, 0);
+        }
+        if (level == level_) {
+            return false;
+        }
+        level_ = level;
+        return true;
+    }
+
+    /**
+     * @brief Current quality level, 0 is the full quality
+     *
+     */
+    int level() const { return level_; }
+
+    const GovernorConfig& config() const { return config_; }
+
+private:
+    GovernorConfig config_;
+    int64_t deadline_ns_;
+    int64_t max_age_ns_;
+    int level_ = 0;
+    // Frames and time recorded since the last decision
+    int frames_ = 0;
+    int64_t total_ns_ = 0;
+};
+
+}  // namespace your_pointcloud_package
+
+#endif  // YOUR_POINTCLOUD_PACKAGE_LOAD_GOVERNOR_H
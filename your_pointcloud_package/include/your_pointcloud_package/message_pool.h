@@ -0,0 +1,201 @@
+/**
+ * @file message_pool.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Pool of preallocated messages handed out as boost::shared_ptr. The custom
+ * deleter puts a message back into the pool once the publisher and every intra process
+ * subscriber have released it, so its buffers keep their capacity from frame to frame.
+ * The control blocks of the shared pointers come from a slab of the pool as well, in
+ * steady state acquiring and releasing a message never touches the heap.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef YOUR_POINTCLOUD_PACKAGE_MESSAGE_POOL_H
+#define YOUR_POINTCLOUD_PACKAGE_MESSAGE_POOL_H
+
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace your_pointcloud_package {
+
+template <typename M>
+class MessagePool {
+public:
+    using Ptr = boost::shared_ptr<M>;
+
+    struct Stats {
+        // Messages owned by the pool, handed out or not
+        size_t size = 0;
+        size_t in_use = 0;
+        // Most messages handed out at the same time
+        size_t high_water = 0;
+        // Messages created after the construction because the pool ran dry
+        uint64_t misses = 0;
+    };
+
+    /**
+     * @param capacity Messages created up front
+     * @param init Called once on every new message, e.g. to reserve its buffers
+     */
+    explicit MessagePool(size_t capacity, std::function<void(M&)> init = std::function<void(M&)>())
+        : state_(std::make_shared<State>(std::max<size_t>(capacity, 1), std::move(init))) {}
+
+    /**
+     * @brief A free message, as the last user left it. A new one is created and kept
+     * when all of them are in use.
+     *
+     * Safe from any thread, the messages may also be released on any thread.
+     */
+    Ptr acquire() {
+        M* msg = state_->take();
+        return Ptr(msg, Recycler{state_}, BlockAllocator<M>(state_));
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->stats;
+    }
+
+private:
+    // Slots of the control block slab, a boost control block with a deleter and an
+    // allocator holding a std::shared_ptr is well below this
+    static constexpr size_t kBlockSize = 128;
+
+    /**
+     * @brief Shared by the pool and every message it handed out, so a message released
+     * after the pool is gone still finds its way back and the last one frees it all
+     *
+     */
+    struct State {
+        State(size_t capacity, std::function<void(M&)> init_message)
+            : init(std::move(init_message)), blocks(2 * capacity) {
+            free_messages.reserve(2 * capacity);
+            free_blocks.reserve(blocks.size());
+            for (size_t i = 0; i < capacity; ++i) {
+                free_messages.push_back(create());
+            }
+            for (size_t i = blocks.size(); i > 0; --i) {
+                free_blocks.push_back(&blocks[i - 1]);
+            }
+            stats.size = capacity;
+        }
+
+        ~State() {
+            for (M* msg : free_messages) {
+                delete msg;
+            }
+        }
+
+        M* create() const {
+            M* msg = new M();
+            if (init) {
+                init(*msg);
+            }
+            return msg;
+        }
+
+        M* take() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++stats.in_use;
+                stats.high_water = std::max(stats.high_water, stats.in_use);
+                if (!free_messages.empty()) {
+                    M* msg = free_messages.back();
+                    free_messages.pop_back();
+                    return msg;
+                }
+                ++stats.misses;
+                ++stats.size;
+            }
+            // The pool grows for good, the next frames find the message again
+            return create();
+        }
+
+        void give(M* msg) {
+            std::lock_guard<std::mutex> lock(mutex);
+            --stats.in_use;
+            free_messages.push_back(msg);
+        }
+
+        void* allocateBlock(size_t bytes) {
+            if (bytes <= kBlockSize) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!free_blocks.empty()) {
+                    Block* block = free_blocks.back();
+                    free_blocks.pop_back();
+                    return block;
+                }
+            }
+            return ::operator new(bytes);
+        }
+
+        void freeBlock(void* p) {
+            Block* block = static_cast<Block*>(p);
+            if (!blocks.empty() && block >= &blocks.front() && block <= &blocks.back()) {
+                std::lock_guard<std::mutex> lock(mutex);
+                free_blocks.push_back(block);
+                return;
+            }
+            ::operator delete(p);
+        }
+
+        struct alignas(std::max_align_t) Block {
+            unsigned char bytes[kBlockSize];
+        };
+
+        mutable std::mutex mutex;
+        const std::function<void(M&)> init;
+        std::vector<M*> free_messages;
+        std::vector<Block> blocks;
+        std::vector<Block*> free_blocks;
+        Stats stats;
+    };
+
+    struct Recycler {
+        std::shared_ptr<State> state;
+        void operator()(M* msg) const { state->give(msg); }
+    };
+
+    /**
+     * @brief Allocator of the control blocks, hands out the slots of the slab
+     *
+     */
+    template <typename T>
+    struct BlockAllocator {
+        using value_type = T;
+
+        explicit BlockAllocator(std::shared_ptr<State> pool_state) : state(std::move(pool_state)) {}
+
+        template <typename U>
+        BlockAllocator(const BlockAllocator<U>& other) : state(other.state) {}
+
+        T* allocate(size_t n) { return static_cast<T*>(state->allocateBlock(n * sizeof(T))); }
+
+        void deallocate(T* p, size_t) { state->freeBlock(p); }
+
+        template <typename U>
+        bool operator==(const BlockAllocator<U>& other) const { return state == other.state; }
+
+        template <typename U>
+        bool operator!=(const BlockAllocator<U>& other) const { return state != other.state; }
+
+        std::shared_ptr<State> state;
+    };
+
+    std::shared_ptr<State> state_;
+};
+
+}  // namespace your_pointcloud_package
+
+#endif  // YOUR_POINTCLOUD_PACKAGE_MESSAGE_POOL_H
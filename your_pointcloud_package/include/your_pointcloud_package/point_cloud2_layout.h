@@ -0,0 +1,50 @@
+/**
+ * @file point_cloud2_layout.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Reads the x, y, z field layout of a sensor_msgs::PointCloud2 so the kernels can
+ * work on the raw byte buffer
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef YOUR_POINTCLOUD_PACKAGE_POINT_CLOUD2_LAYOUT_H
+#define YOUR_POINTCLOUD_PACKAGE_POINT_CLOUD2_LAYOUT_H
+
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+#include <your_pointcloud_package/tof_filter_transform.h>
+
+namespace your_pointcloud_package {
+
+/**
+ * @brief Reads the float32 x, y, z layout of the cloud
+ *
+ * @return false if the cloud does not carry float32 x, y, z fields in host byte order,
+ * or if its steps and data size do not cover every point, see layoutFits
+ */
+inline bool resolveCloudLayout(const sensor_msgs::PointCloud2& msg, CloudLayout& layout) {
+    if (msg.is_bigendian) {
+        return false;
+    }
+    int found = 0;
+    for (const auto& field : msg.fields) {
+        if (field.datatype != sensor_msgs::PointField::FLOAT32) {
+            continue;
+        }
+        if (field.name == "x") { layout.offset_x = field.offset; found |= 1; }
+        else if (field.name == "y") { layout.offset_y = field.offset; found |= 2; }
+        else if (field.name == "z") { layout.offset_z = field.offset; found |= 4; }
+    }
+    layout.point_step = msg.point_step;
+    layout.row_step = msg.row_step;
+    layout.width = msg.width;
+    layout.height = msg.height;
+    return found == 7 && layoutFits(layout, msg.data.size());
+}
+
+}  // namespace your_pointcloud_package
+
+#endif  // YOUR_POINTCLOUD_PACKAGE_POINT_CLOUD2_LAYOUT_H
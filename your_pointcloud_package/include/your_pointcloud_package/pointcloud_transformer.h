@@ -0,0 +1,80 @@
+/**
+ * @file pointcloud_transformer.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Filters the ToF point cloud on /tof_pc and republishes it in the hires camera
+ * frame on /rgb_pcl. Used by the standalone node and by the nodelet.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef YOUR_POINTCLOUD_PACKAGE_POINTCLOUD_TRANSFORMER_H
+#define YOUR_POINTCLOUD_PACKAGE_POINTCLOUD_TRANSFORMER_H
+
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <std_msgs/UInt8.h>
+#include <tf2_ros/buffer.h>
+#include <tf2_ros/transform_listener.h>
+#include <pipeline_diagnostics/stage_diagnostics.h>
+#include <your_pointcloud_package/load_governor.h>
+#include <your_pointcloud_package/message_pool.h>
+#include <your_pointcloud_package/tof_cloud_processor.h>
+#include <your_pointcloud_package/transform_cache.h>
+
+#include <memory>
+
+namespace your_pointcloud_package {
+
+class PointCloudTransformer {
+public:
+    /**
+     * @brief Subscribes to /tof_pc and advertises /rgb_pcl on nh, parameters are read from pnh
+     *
+     */
+    PointCloudTransformer(ros::NodeHandle nh, ros::NodeHandle pnh);
+
+    void pc_callback(const sensor_msgs::PointCloud2ConstPtr& pc_msg);
+
+private:
+    // Stages timed on /diagnostics, after the ones of the processor
+    enum Stage : size_t {
+        kStagePublish = TofCloudProcessor::kStageCount,
+        kStageCallback,
+        kStageAgeIn,
+        kStageAgeOut,
+    };
+    // Counters on /diagnostics
+    enum Counter : size_t {
+        kCounterDropped,
+        // Clouds dropped by the governor because they arrived too old
+        kCounterStale,
+        // Gauge of the governor level
+        kCounterQualityLevel,
+        // Gauges of the output pool, see StageDiagnostics::poolGauges
+        kCounterOutputPool,
+    };
+
+    std::unique_ptr<tf2_ros::Buffer> tf_buffer_;
+    std::unique_ptr<tf2_ros::TransformListener> tf_listener_;
+    std::unique_ptr<TransformCache> transform_cache_;
+    ros::Subscriber pc_sub_;
+    ros::Publisher pc_pub_;
+    // Latched level of the governor
+    ros::Publisher level_pub_;
+    // Output messages with their buffers reserved for a full ToF frame, a message comes
+    // back once every subscriber released it
+    std::unique_ptr<MessagePool<sensor_msgs::PointCloud2>> output_pool_;
+    std::unique_ptr<pipeline_diagnostics::StageDiagnostics> diagnostics_;
+    std::unique_ptr<TofCloudProcessor> processor_;
+    // Clouds skipped on /tof_pc, from the gaps in header.seq
+    pipeline_diagnostics::SequenceGap input_gap_;
+    // Drops stale clouds and sets the quality level of processor_ from the callback time
+    LoadGovernor governor_;
+};
+
+}  // namespace your_pointcloud_package
+
+#endif  // YOUR_POINTCLOUD_PACKAGE_POINTCLOUD_TRANSFORMER_H
@@ -0,0 +1,81 @@
+/**
+ * @file tiled_filter_transform.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Runs the fused ToF filter and transform kernel over a whole cloud, split into
+ * tiles on the worker pool when the cloud is large enough
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef YOUR_POINTCLOUD_PACKAGE_TILED_FILTER_TRANSFORM_H
+#define YOUR_POINTCLOUD_PACKAGE_TILED_FILTER_TRANSFORM_H
+
+#include <your_pointcloud_package/tof_filter_transform.h>
+#include <your_pointcloud_package/worker_pool.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace your_pointcloud_package {
+
+/**
+ * @brief Filters and transforms the whole cloud into out, which is cleared first. The
+ * kernel writes into scratch and the survivors are appended to out tile by tile, so out
+ * only grows by the points kept and is never zero filled. Clouds of at least
+ * parallel_min_points are cut into tiles of tile_points that the pool processes in
+ * parallel, each tile at its own offset of scratch. Smaller clouds, or a null pool, run
+ * tile after tile on the calling thread through the front of scratch.
+ *
+ * @param pool Worker pool, may be null
+ * @param tile_counts Scratch space for the per tile counts, reserve it to avoid allocations
+ * @param scratch Kernel output, grown to layout.size() * kOutputPointStep bytes when the
+ * pool runs. Size it for the largest cloud to avoid allocations.
+ * @param out Survivors, reserve it for the largest cloud to avoid allocations
+ * @return size_t Number of points in out
+ */
+inline size_t filterTransformTiled(WorkerPool* pool, std::vector<size_t>& tile_counts, size_t tile_points,
+                                   size_t parallel_min_points, const uint8_t* in, const CloudLayout& layout,
+                                   const PacketTransform& T, const TofGate& gate, std::vector<uint8_t>& scratch,
+                                   std::vector<uint8_t>& out) {
+    const size_t n_in = layout.size();
+    const bool parallel = pool != nullptr && n_in >= parallel_min_points;
+    const size_t scratch_points = parallel ? n_in : std::min(n_in, tile_points);
+    if (scratch.size() < scratch_points * kOutputPointStep) {
+        scratch.resize(scratch_points * kOutputPointStep);
+    }
+    out.clear();
+    if (!parallel) {
+        withPointFields(layout, [&](const auto& fields) {
+            for (size_t begin = 0; begin < n_in; begin += tile_points) {
+                const size_t end = std::min(n_in, begin + tile_points);
+                const size_t n = filterTransformTof(in, layout, fields, begin, end, T, gate, scratch.data());
+                out.insert(out.end(), scratch.data(), scratch.data() + n * kOutputPointStep);
+            }
+        });
+        return out.size() / kOutputPointStep;
+    }
+    const size_t n_tiles = (n_in + tile_points - 1) / tile_points;
+    tile_counts.resize(n_tiles);
+    withPointFields(layout, [&](const auto& fields) {
+        pool->parallelFor(n_tiles, [&](size_t tile, size_t) {
+            const size_t begin = tile * tile_points;
+            const size_t end = std::min(n_in, begin + tile_points);
+            tile_counts[tile] = filterTransformTof(in, layout, fields, begin, end, T, gate,
+                                                   scratch.data() + begin * kOutputPointStep);
+        });
+    });
+    for (size_t tile = 0; tile < n_tiles; ++tile) {
+        const uint8_t* survivors = scratch.data() + tile * tile_points * kOutputPointStep;
+        out.insert(out.end(), survivors, survivors + tile_counts[tile] * kOutputPointStep);
+    }
+    return out.size() / kOutputPointStep;
+}
+
+}  // namespace your_pointcloud_package
+
+#endif  // YOUR_POINTCLOUD_PACKAGE_TILED_FILTER_TRANSFORM_H
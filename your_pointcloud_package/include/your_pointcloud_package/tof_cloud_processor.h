@@ -0,0 +1,147 @@
+/**
+ * @file tof_cloud_processor.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief The per frame work of the transform stage without the ROS transport: filters,
+ * transforms and downsamples one ToF cloud into an /rgb_pcl message. Shared by the
+ * PointCloudTransformer node and the offline pipeline.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef YOUR_POINTCLOUD_PACKAGE_TOF_CLOUD_PROCESSOR_H
+#define YOUR_POINTCLOUD_PACKAGE_TOF_CLOUD_PROCESSOR_H
+
+#include <ros/console.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <pipeline_diagnostics/latency_stats.h>
+#include <your_pointcloud_package/cloud_downsample.h>
+#include <your_pointcloud_package/tof_filter_transform.h>
+#include <your_pointcloud_package/worker_pool.h>
+#include <Eigen/Core>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace your_pointcloud_package {
+
+/**
+ * @brief Parameters of the transform stage
+ *
+ */
+struct TofCloudConfig {
+    // Cores are numbered like the CPUS enum (1 = CPU1), 0 leaves a worker unpinned.
+    // The default puts the workers on the big cores of the VOXL.
+    std::vector<int> worker_cpus{6, 7, 8};
+    int tile_points = 1024;
+    int parallel_min_points = 8192;
+    // ~downsample: none, stride over the organized input or voxel grid over the output
+    DownsampleMode downsample = DownsampleMode::kNone;
+    int stride = 2;
+    // Voxel leaf in meters, grown to meet max_points
+    double voxel_size = 0.02;
+    // Point budget of /rgb_pcl, 0 for none
+    int max_points = 0;
+    // Every quality level of the load governor halves the point budget, from max_points
+    // or the full frame, and pulls the far end of the z gate in by z_step meters
+    double z_step = 0.1;
+
+    /**
+     * @brief Reads the parameters through params.param(name, value, default), from a
+     * private ros::NodeHandle or anything with the same interface
+     *
+     */
+    template <typename Params>
+    void load(const Params& params) {
+        params.param("worker_cpus", worker_cpus, std::vector<int>{6, 7, 8});
+        params.param("tile_points", tile_points, 1024);
+        params.param("parallel_min_points", parallel_min_points, 8192);
+        tile_points = std::max(tile_points, 64);
+        std::string mode;
+        params.param("downsample", mode, std::string("none"));
+        params.param("stride", stride, 2);
+        params.param("voxel_size", voxel_size, 0.02);
+        params.param("max_points", max_points, 0);
+        params.param("governor_z_step", z_step, 0.1);
+        downsample = DownsampleMode::kNone;
+        if (!parseDownsampleMode(mode, downsample)) {
+            ROS_WARN("Unknown downsample mode %s, expected none, stride or voxel. Not downsampling", mode.c_str());
+        }
+        stride = std::max(stride, 1);
+        max_points = std::max(max_points, 0);
+        z_step = std::max(z_step, 0.0);
+        if (downsample == DownsampleMode::kVoxel && !(voxel_size > 0.0)) {
+            ROS_WARN("voxel_size must be positive, got %f. Not downsampling", voxel_size);
+            downsample = DownsampleMode::kNone;
+        }
+    }
+};
+
+class TofCloudProcessor {
+public:
+    // Stages recorded into the StageStats given to the constructor, from index 0
+    enum Stage : size_t {
+        kStageLayout,
+        kStageFilterTransform,
+        kStageDownsample,
+        kStageCount,
+    };
+
+    static std::vector<std::string> stageNames() { return {"layout", "filter_transform", "downsample"}; }
+
+    // Number of pixels of the VOXL ToF sensor (224 x 172)
+    static constexpr size_t kTofMaxPoints = 38528;
+
+    /**
+     * @param stats Histograms of the stages, the first kStageCount are used
+     */
+    TofCloudProcessor(const TofCloudConfig& config, pipeline_diagnostics::StageStats& stats);
+
+    /**
+     * @brief Sets up the fields, frame and capacity of an output message
+     *
+     */
+    static void initOutput(sensor_msgs::PointCloud2& msg);
+
+    /**
+     * @brief Filters, transforms and downsamples in into out, which keeps the stamp and
+     * the seq of in. out must have been set up by initOutput, its buffer is reused.
+     *
+     * @param world_to_hires Transform from the frame of in into hires
+     * @return false if in has no float32 x, y, z fields, out is left untouched
+     */
+    bool process(const sensor_msgs::PointCloud2& in, const Eigen::Matrix<float, 3, 4>& world_to_hires,
+                 sensor_msgs::PointCloud2& out);
+
+    /**
+     * @brief Trades quality for time, see TofCloudConfig::z_step. Level 0 is the
+     * configured quality.
+     *
+     */
+    void setQualityLevel(int level);
+
+private:
+    TofCloudConfig config_;
+    pipeline_diagnostics::StageStats& stats_;
+    PacketTransform world_to_hires_;
+    TofGate tof_gate_;
+    // Point budget of the current quality level, 0 for none
+    int max_points_;
+    std::unique_ptr<WorkerPool> pool_;
+    std::vector<size_t> tile_counts_;
+    // Written by the kernel, the survivors are copied into the output message
+    std::vector<uint8_t> filter_scratch_;
+    // Current voxel leaf, follows max_points_
+    float voxel_leaf_;
+    std::unique_ptr<VoxelGrid> voxel_grid_;
+    // Layout of the last input, logged when it changes
+    PointFormat input_format_ = PointFormat::kGeneric;
+};
+
+}  // namespace your_pointcloud_package
+
+#endif  // YOUR_POINTCLOUD_PACKAGE_TOF_CLOUD_PROCESSOR_H
@@ -0,0 +1,282 @@
+/**
+ * @file tof_filter_transform.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Fused single pass kernel that gates the raw ToF points of a PointCloud2 byte
+ * buffer and applies the rigid world->hires transform on the fly
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef YOUR_POINTCLOUD_PACKAGE_TOF_FILTER_TRANSFORM_H
+#define YOUR_POINTCLOUD_PACKAGE_TOF_FILTER_TRANSFORM_H
+
+#include <Eigen/Core>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace your_pointcloud_package {
+
+/**
+ * @brief Byte layout of the float32 x, y, z fields of an incoming PointCloud2
+ *
+ */
+struct CloudLayout {
+    uint32_t offset_x = 0;
+    uint32_t offset_y = 4;
+    uint32_t offset_z = 8;
+    uint32_t point_step = 16;
+    uint32_t row_step = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    size_t size() const { return static_cast<size_t>(width) * height; }
+};
+
+/**
+ * @brief Whether every x, y, z the kernels read from a data buffer of data_size bytes
+ * laid out as layout lies inside that buffer. The kernels trust the layout, a cloud
+ * failing this must not reach them.
+ *
+ */
+inline bool layoutFits(const CloudLayout& layout, size_t data_size) {
+    const uint64_t last_field = std::max(std::max(layout.offset_x, layout.offset_y), layout.offset_z);
+    if (last_field + sizeof(float) > layout.point_step) {
+        return false;
+    }
+    const uint64_t row_bytes = static_cast<uint64_t>(layout.width) * layout.point_step;
+    if (layout.row_step < row_bytes) {
+        return false;
+    }
+    if (layout.size() == 0) {
+        return true;
+    }
+    return (static_cast<uint64_t>(layout.height) - 1) * layout.row_step + row_bytes <= data_size;
+}
+
+/**
+ * @brief Point step of the clouds written by the kernel. Same layout as pcl::PointXYZ
+ * (x, y, z, padding) so subscribers using pcl::fromROSMsg see the usual cloud
+ *
+ */
+constexpr uint32_t kOutputPointStep = 16;
+
+/**
+ * @brief Gate applied on the raw ToF z value before the transform. z_min must stay
+ * positive: the sensor reports pixels without a return as (0, 0, 0), and z = 0 falling
+ * below the gate is what drops them, the kernels do not test for all zero points.
+ *
+ */
+struct TofGate {
+    float z_min = 0.2f;
+    float z_max = 1.5f;
+};
+
+/**
+ * @brief Rigid 3x4 transform stored as four columns so every point costs three
+ * broadcast multiply-adds on a single SIMD packet (SSE/NEON through Eigen)
+ *
+ */
+struct PacketTransform {
+    Eigen::Vector4f c0;
+    Eigen::Vector4f c1;
+    Eigen::Vector4f c2;
+    Eigen::Vector4f c3;
+
+    PacketTransform() { set(Eigen::Matrix<float, 3, 4>::Identity()); }
+    explicit PacketTransform(const Eigen::Matrix<float, 3, 4>& T) { set(T); }
+
+    void set(const Eigen::Matrix<float, 3, 4>& T) {
+        c0 = Eigen::Vector4f(T(0, 0), T(1, 0), T(2, 0), 0.0f);
+        c1 = Eigen::Vector4f(T(0, 1), T(1, 1), T(2, 1), 0.0f);
+        c2 = Eigen::Vector4f(T(0, 2), T(1, 2), T(2, 2), 0.0f);
+        // The fourth lane evaluates to 1 which is the padding value pcl writes for PointXYZ
+        c3 = Eigen::Vector4f(T(0, 3), T(1, 3), T(2, 3), 1.0f);
+    }
+
+    Eigen::Vector4f apply(float x, float y, float z) const {
+        return c0 * x + c1 * y + c2 * z + c3;
+    }
+};
+
+/**
+ * @brief Checks the exponent bits directly so the test survives -ffast-math, where
+ * std::isnan/std::isinf are allowed to be folded away
+ *
+ */
+inline bool isFiniteBits(float v) {
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    return (bits & 0x7f800000u) != 0x7f800000u;
+}
+
+inline float loadFloat(const uint8_t* p) {
+    float v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * @brief Reads x, y, z through the field offsets of the message, works for any layout
+ *
+ */
+struct RuntimeFields {
+    explicit RuntimeFields(const CloudLayout& layout)
+        : offset_x(layout.offset_x), offset_y(layout.offset_y), offset_z(layout.offset_z),
+          point_step(layout.point_step) {}
+
+    uint32_t step() const { return point_step; }
+
+    void load(const uint8_t* p, float& x, float& y, float& z) const {
+        x = loadFloat(p + offset_x);
+        y = loadFloat(p + offset_y);
+        z = loadFloat(p + offset_z);
+    }
+
+    uint32_t offset_x;
+    uint32_t offset_y;
+    uint32_t offset_z;
+    uint32_t point_step;
+};
+
+/**
+ * @brief Reads x, y, z packed at offsets 0, 4, 8 of a point of Step bytes. Step 12 is
+ * the VOXL ToF cloud, step 16 pcl::PointXYZ and the kernel output. With the offsets and
+ * the stride known at compile time the three loads become one 12 byte copy at a fixed
+ * displacement and the point address a constant increment.
+ *
+ */
+template <uint32_t Step>
+struct PackedXyzFields {
+    static constexpr uint32_t step() { return Step; }
+
+    static void load(const uint8_t* p, float& x, float& y, float& z) {
+        float xyz[3];
+        std::memcpy(xyz, p, sizeof(xyz));
+        x = xyz[0];
+        y = xyz[1];
+        z = xyz[2];
+    }
+};
+
+/**
+ * @brief Point layouts the kernels have a compiled in specialization for
+ *
+ */
+enum class PointFormat {
+    kGeneric,
+    kPackedXyz12,
+    kPackedXyz16,
+};
+
+inline const char* pointFormatName(PointFormat format) {
+    switch (format) {
+        case PointFormat::kPackedXyz12: return "packed xyz, 12 byte points";
+        case PointFormat::kPackedXyz16: return "packed xyz, 16 byte points";
+        default: return "generic";
+    }
+}
+
+/**
+ * @brief Matches the layout against the specialized formats. Views that change the point
+ * step, like a stride, fall back to kGeneric.
+ *
+ */
+inline PointFormat pointFormat(const CloudLayout& layout) {
+    if (layout.offset_x != 0 || layout.offset_y != 4 || layout.offset_z != 8) {
+        return PointFormat::kGeneric;
+    }
+    switch (layout.point_step) {
+        case 12: return PointFormat::kPackedXyz12;
+        case 16: return PointFormat::kPackedXyz16;
+        default: return PointFormat::kGeneric;
+    }
+}
+
+/**
+ * @brief Calls fn with the field reader of the layout: a PackedXyzFields specialization
+ * when one matches, RuntimeFields otherwise. The layout is checked once here, the
+ * kernel instantiated for the reader does no per point layout work. Only the filter
+ * dispatches through here, the gates gather packets lane by lane and stay on
+ * RuntimeFields.
+ *
+ */
+template <typename Fn>
+decltype(auto) withPointFields(const CloudLayout& layout, Fn&& fn) {
+    switch (pointFormat(layout)) {
+        case PointFormat::kPackedXyz12: return fn(PackedXyzFields<12>());
+        case PointFormat::kPackedXyz16: return fn(PackedXyzFields<16>());
+        default: return fn(RuntimeFields(layout));
+    }
+}
+
+/**
+ * @brief Filters and transforms the points [begin, end) of the cloud (row major point
+ * index) and writes the survivors packed at out. NaN, inf and out of range points are
+ * dropped, all zero points too since z = 0 is below gate.z_min.
+ *
+ * @param in Start of the PointCloud2 data buffer
+ * @param layout Layout of the input cloud
+ * @param fields Field reader matching layout, see withPointFields
+ * @param begin First point index
+ * @param end One past the last point index
+ * @param T Packed rigid transform
+ * @param gate z gate in the input frame
+ * @param out Output buffer, must hold (end - begin) * kOutputPointStep bytes
+ * @return size_t Number of points written
+ */
+template <typename Fields>
+size_t filterTransformTof(const uint8_t* in, const CloudLayout& layout, const Fields& fields,
+                          size_t begin, size_t end,
+                          const PacketTransform& T, const TofGate& gate,
+                          uint8_t* out) {
+    if (layout.width == 0 || begin >= end) {
+        return 0;
+    }
+    size_t written = 0;
+    size_t row = begin / layout.width;
+    size_t col = begin % layout.width;
+    size_t i = begin;
+    while (i < end) {
+        const size_t row_end = std::min(end, i + (layout.width - col));
+        const uint8_t* p = in + row * layout.row_step + col * fields.step();
+        for (; i < row_end; ++i, p += fields.step()) {
+            float x, y, z;
+            fields.load(p, x, y, z);
+            if (!(isFiniteBits(x) && isFiniteBits(y) && isFiniteBits(z))) {
+                continue;
+            }
+            // Also drops the all zero points of the pixels without a return, z_min > 0
+            if (z < gate.z_min || z > gate.z_max) {
+                continue;
+            }
+            Eigen::Map<Eigen::Vector4f>(reinterpret_cast<float*>(out + written * kOutputPointStep)) =
+                T.apply(x, y, z);
+            ++written;
+        }
+        ++row;
+        col = 0;
+    }
+    return written;
+}
+
+/**
+ * @brief filterTransformTof with the field reader picked for layout
+ *
+ */
+inline size_t filterTransformTof(const uint8_t* in, const CloudLayout& layout,
+                                 size_t begin, size_t end,
+                                 const PacketTransform& T, const TofGate& gate,
+                                 uint8_t* out) {
+    return withPointFields(layout, [&](const auto& fields) {
+        return filterTransformTof(in, layout, fields, begin, end, T, gate, out);
+    });
+}
+
+}  // namespace your_pointcloud_package
+
+#endif  // YOUR_POINTCLOUD_PACKAGE_TOF_FILTER_TRANSFORM_H
@@ -0,0 +1,217 @@
+/**
+ * @file transform_cache.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Caches resolved tf chains as float 3x4 matrices and only asks tf2 again when
+ * a transform of the chain may have changed: on any tf update for chains with dynamic
+ * links, only on /tf_static updates for chains that are static end to end
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef YOUR_POINTCLOUD_PACKAGE_TRANSFORM_CACHE_H
+#define YOUR_POINTCLOUD_PACKAGE_TRANSFORM_CACHE_H
+
+#include <ros/ros.h>
+#include <tf2/buffer_core.h>
+#include <tf2/exceptions.h>
+#include <tf2_msgs/TFMessage.h>
+#include <geometry_msgs/TransformStamped.h>
+#include <Eigen/Geometry>
+#include <boost/bind/bind.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace your_pointcloud_package {
+
+/**
+ * @brief Converts a tf message into the rigid 3x4 matrix mapping source points into the
+ * target frame
+ *
+ */
+inline Eigen::Matrix<float, 3, 4> toMatrix3x4(const geometry_msgs::Transform& transform) {
+    const auto& t = transform.translation;
+    const auto& r = transform.rotation;
+    Eigen::Matrix<float, 3, 4> T;
+    T.leftCols<3>() = Eigen::Quaterniond(r.w, r.x, r.y, r.z).normalized().toRotationMatrix().cast<float>();
+    T.col(3) = Eigen::Vector3d(t.x, t.y, t.z).cast<float>();
+    return T;
+}
+
+/**
+ * @brief Latest transform cache keyed by (target, source). The chain is resolved through
+ * tf2 on the first request, all other requests are served from the stored matrix
+ * without touching the tf2 mutex until the chain has to be resolved again:
+ *
+ * - a chain with a dynamic link, tf2 stamps it with the time of its latest common
+ *   transform, is resolved again after any update of the buffer;
+ * - a chain made of static links only, tf2 stamps it with time 0, is resolved again
+ *   only after a static update. Dynamic /tf at camera rate from VIO leaves it cached.
+ *
+ * The static updates reach the cache through setStaticTransforms, subscribeStatic does
+ * that for /tf_static. Without either, static chains stay cached for good, which suits a
+ * buffer filled once up front.
+ *
+ * lookup must be called from one thread at a time. The change notifications and the
+ * counters are safe to use from any thread.
+ */
+class TransformCache {
+public:
+    explicit TransformCache(tf2::BufferCore& buffer) : buffer_(buffer) {
+        changed_connection_ = buffer_._addTransformsChangedListener(
+            boost::bind(&TransformCache::onTransformsChanged, this));
+    }
+
+    ~TransformCache() {
+        buffer_._removeTransformsChangedListener(changed_connection_);
+    }
+
+    TransformCache(const TransformCache&) = delete;
+    TransformCache& operator=(const TransformCache&) = delete;
+
+    /**
+     * @brief Latest transform taking points from source into target
+     *
+     * @param T Set to the cached matrix on success
+     * @param error Set to the tf2 error message on failure, may be null
+     * @return false if tf2 cannot resolve the chain
+     */
+    bool lookup(const std::string& target, const std::string& source,
+                Eigen::Matrix<float, 3, 4>& T, std::string* error = nullptr) {
+        const uint64_t generation = generation_.load(std::memory_order_acquire);
+        const uint64_t static_generation = static_generation_.load(std::memory_order_acquire);
+        Entry* entry = find(target, source);
+        if (entry != nullptr &&
+            entry->generation == (entry->static_chain ? static_generation : generation)) {
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            T = entry->T;
+            return true;
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        geometry_msgs::TransformStamped stamped;
+        try {
+            stamped = buffer_.lookupTransform(target, source, ros::Time(0));
+        } catch (const tf2::TransformException& ex) {
+            failures_.fetch_add(1, std::memory_order_relaxed);
+            if (error != nullptr) {
+                *error = ex.what();
+            }
+            return false;
+        }
+        if (entry == nullptr) {
+            entries_.push_back(Entry{target, source, Eigen::Matrix<float, 3, 4>::Zero(), false, 0});
+            entry = &entries_.back();
+        }
+        const Eigen::Matrix<float, 3, 4> resolved = toMatrix3x4(stamped.transform);
+        if (resolved != entry->T) {
+            changes_.fetch_add(1, std::memory_order_relaxed);
+            entry->T = resolved;
+        }
+        // A modification that raced with the lookup leaves the generation ahead, so the
+        // next call resolves the chain again
+        entry->static_chain = stamped.header.stamp.isZero();
+        entry->generation = entry->static_chain ? static_generation : generation;
+        T = entry->T;
+        return true;
+    }
+
+    /**
+     * @brief Inserts static transforms into the buffer, then marks the static chains
+     * for a new resolution. Safe from any thread.
+     *
+     */
+    void setStaticTransforms(const tf2_msgs::TFMessage& msg, const std::string& authority) {
+        for (const geometry_msgs::TransformStamped& transform : msg.transforms) {
+            try {
+                buffer_.setTransform(transform, authority, true);
+            } catch (const tf2::TransformException& ex) {
+                ROS_WARN_THROTTLE(1.0, "Could not insert the static transform %s -> %s: %s",
+                                  transform.header.frame_id.c_str(), transform.child_frame_id.c_str(), ex.what());
+            }
+        }
+        // Only after the insertion, a lookup that sees the new generation finds the new data
+        static_generation_.fetch_add(1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Feeds /tf_static to setStaticTransforms. The tf listener of the buffer
+     * inserts the same transforms again, which tf2 takes as a no op.
+     *
+     */
+    void subscribeStatic(ros::NodeHandle nh) {
+        static_sub_ = nh.subscribe<tf2_msgs::TFMessage>(
+            "/tf_static", 100, [this](const tf2_msgs::TFMessage::ConstPtr& msg) {
+                setStaticTransforms(*msg, "tf_static");
+            });
+    }
+
+    /**
+     * @brief Requests served from the cache
+     *
+     */
+    uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Requests that had to go through tf2
+     *
+     */
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Misses where tf2 could not resolve the chain
+     *
+     */
+    uint64_t failures() const { return failures_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Misses that produced a different matrix than the cached one
+     *
+     */
+    uint64_t changes() const { return changes_.load(std::memory_order_relaxed); }
+
+private:
+    struct Entry {
+        std::string target;
+        std::string source;
+        Eigen::Matrix<float, 3, 4> T;
+        // Every link of the chain is static, only static updates invalidate it
+        bool static_chain;
+        // generation_ or static_generation_ when the chain was resolved
+        uint64_t generation;
+    };
+
+    Entry* find(const std::string& target, const std::string& source) {
+        for (auto& entry : entries_) {
+            if (entry.source == source && entry.target == target) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    void onTransformsChanged() {
+        generation_.fetch_add(1, std::memory_order_release);
+    }
+
+    tf2::BufferCore& buffer_;
+    boost::signals2::connection changed_connection_;
+    // Starts ahead of the entries so the first lookup always goes through tf2
+    std::atomic<uint64_t> generation_{1};
+    // Bumped by setStaticTransforms only
+    std::atomic<uint64_t> static_generation_{1};
+    ros::Subscriber static_sub_;
+    std::vector<Entry> entries_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> failures_{0};
+    std::atomic<uint64_t> changes_{0};
+};
+
+}  // namespace your_pointcloud_package
+
+#endif  // YOUR_POINTCLOUD_PACKAGE_TRANSFORM_CACHE_H
@@ -0,0 +1,199 @@
+/**
+ * @file worker_pool.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Persistent pool of pinned worker threads that run tiled point kernels with
+ * work stealing. Threads are created once, every frame only wakes them up.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef YOUR_POINTCLOUD_PACKAGE_WORKER_POOL_H
+#define YOUR_POINTCLOUD_PACKAGE_WORKER_POOL_H
+
+#include <your_pointcloud_package/cpu_affinity.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace your_pointcloud_package {
+
+/**
+ * @brief Fixed set of worker threads plus the calling thread. parallelFor splits the
+ * tiles evenly between the participants, a participant that runs out of its own tiles
+ * steals the remaining ones of the others.
+ *
+ */
+class WorkerPool {
+public:
+    /**
+     * @brief Spawns one worker per entry of worker_cpus. An entry of 0 leaves the worker
+     * unpinned, otherwise it is the 1 based core number (see cpuFromIndex)
+     *
+     */
+    explicit WorkerPool(const std::vector<int>& worker_cpus)
+        : slots_(new Slot[worker_cpus.size() + 1]) {
+        workers_.reserve(worker_cpus.size());
+        for (size_t i = 0; i < worker_cpus.size(); ++i) {
+            const int cpu_index = worker_cpus[i];
+            workers_.emplace_back([this, i, cpu_index]() { workerLoop(i + 1, cpu_index); });
+        }
+        // Wait for the workers to settle on their cores so pinFailures is final
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this]() { return started_workers_ == workers_.size(); });
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        start_cv_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     * @brief Number of threads taking part in parallelFor, including the caller
+     *
+     */
+    size_t concurrency() const { return workers_.size() + 1; }
+
+    /**
+     * @brief Number of workers that could not be pinned to their core
+     *
+     */
+    size_t pinFailures() const { return pin_failures_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Runs fn(tile, participant) for every tile in [0, n_tiles) and returns once
+     * all of them are done. participant is in [0, concurrency()) and is stable for the
+     * duration of one call, so it can index per thread scratch space.
+     *
+     */
+    template <class F>
+    void parallelFor(size_t n_tiles, F&& fn) {
+        if (n_tiles == 0) {
+            return;
+        }
+        if (workers_.empty() || n_tiles == 1) {
+            for (size_t tile = 0; tile < n_tiles; ++tile) {
+                fn(tile, 0);
+            }
+            return;
+        }
+        using Fn = typename std::remove_reference<F>::type;
+        const size_t participants = concurrency();
+        for (size_t p = 0; p < participants; ++p) {
+            slots_[p].next.store(n_tiles * p / participants, std::memory_order_relaxed);
+            slots_[p].end = n_tiles * (p + 1) / participants;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = &invoke<Fn>;
+            job_ctx_ = static_cast<void*>(&fn);
+            busy_workers_ = workers_.size();
+            ++generation_;
+        }
+        start_cv_.notify_all();
+        runTiles(0);
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this]() { return busy_workers_ == 0; });
+    }
+
+private:
+    /**
+     * @brief Tile range of one participant, padded so owners and thieves of different
+     * slots never share a cache line
+     *
+     */
+    struct alignas(64) Slot {
+        std::atomic<size_t> next{0};
+        size_t end = 0;
+    };
+
+    template <class Fn>
+    static void invoke(void* ctx, size_t tile, size_t participant) {
+        (*static_cast<Fn*>(ctx))(tile, participant);
+    }
+
+    void runTiles(size_t participant) {
+        const size_t participants = concurrency();
+        for (size_t k = 0; k < participants; ++k) {
+            // Own range first, then walk the others and steal what is left
+            Slot& slot = slots_[(participant + k) % participants];
+            size_t tile;
+            while ((tile = slot.next.fetch_add(1, std::memory_order_relaxed)) < slot.end) {
+                job_(job_ctx_, tile, participant);
+            }
+        }
+    }
+
+    void workerLoop(size_t participant, int cpu_index) {
+        CPUS cpu;
+        if (cpu_index != 0) {
+            try {
+                if (!cpuFromIndex(cpu_index, cpu)) {
+                    throw std::runtime_error("Invalid core number " + std::to_string(cpu_index));
+                }
+                applyAffinity(cpu);
+            } catch (const std::runtime_error&) {
+                pin_failures_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++started_workers_;
+        }
+        done_cv_.notify_one();
+        size_t seen_generation = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                start_cv_.wait(lock, [&]() { return stop_ || generation_ != seen_generation; });
+                if (stop_) {
+                    return;
+                }
+                seen_generation = generation_;
+            }
+            runTiles(participant);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (--busy_workers_ != 0) {
+                    continue;
+                }
+            }
+            done_cv_.notify_one();
+        }
+    }
+
+    std::unique_ptr<Slot[]> slots_;
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+    void (*job_)(void*, size_t, size_t) = nullptr;
+    void* job_ctx_ = nullptr;
+    size_t busy_workers_ = 0;
+    size_t started_workers_ = 0;
+    size_t generation_ = 0;
+    bool stop_ = false;
+    std::atomic<size_t> pin_failures_{0};
+};
+
+}  // namespace your_pointcloud_package
+
+#endif  // YOUR_POINTCLOUD_PACKAGE_WORKER_POOL_H
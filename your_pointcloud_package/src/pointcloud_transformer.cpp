@@ -0,0 +1,105 @@
+/**
+ * @file pointcloud_transformer.cpp
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Implementation of the ToF filter and world->hires transform stage
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <your_pointcloud_package/pointcloud_transformer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace your_pointcloud_package {
+
+using pipeline_diagnostics::ScopedStageTimer;
+using pipeline_diagnostics::StageDiagnostics;
+
+PointCloudTransformer::PointCloudTransformer(ros::NodeHandle nh, ros::NodeHandle pnh) {
+    tf_buffer_.reset(new tf2_ros::Buffer());
+    tf_listener_.reset(new tf2_ros::TransformListener(*tf_buffer_, nh));
+    transform_cache_.reset(new TransformCache(*tf_buffer_));
+    // world -> hires is static, only /tf_static updates make the cache resolve it again
+    transform_cache_->subscribeStatic(nh);
+    TofCloudConfig config;
+    config.load(pnh);
+    std::vector<std::string> stages = TofCloudProcessor::stageNames();
+    stages.insert(stages.end(), {"publish", "callback", "age_in", "age_out"});
+    std::vector<std::string> counters{"dropped", "stale", "quality_level"};
+    const std::vector<std::string> pool_gauges = StageDiagnostics::poolGauges("output_pool");
+    counters.insert(counters.end(), pool_gauges.begin(), pool_gauges.end());
+    diagnostics_.reset(new StageDiagnostics(nh, pnh, "pointcloud_transformer", std::move(stages),
+                                            std::move(counters)));
+    processor_.reset(new TofCloudProcessor(config, diagnostics_->stats()));
+    // One message in the callback, one in the subscriber queue of the detection stage and
+    // one it is working on, plus a spare for a late subscriber
+    int message_pool_size;
+    pnh.param("message_pool_size", message_pool_size, 4);
+    output_pool_.reset(new MessagePool<sensor_msgs::PointCloud2>(static_cast<size_t>(std::max(message_pool_size, 1)),
+                                                                 &TofCloudProcessor::initOutput));
+    GovernorConfig governor_config;
+    governor_config.load(pnh);
+    governor_ = LoadGovernor(governor_config);
+    level_pub_ = pnh.advertise<std_msgs::UInt8>("quality_level", 1, true);
+    std_msgs::UInt8 level;
+    level.data = 0;
+    level_pub_.publish(level);
+    pc_pub_ = nh.advertise<sensor_msgs::PointCloud2>("/rgb_pcl", 1);
+    pc_sub_ = nh.subscribe("/tof_pc", 1, &PointCloudTransformer::pc_callback, this);
+}
+
+void PointCloudTransformer::pc_callback(const sensor_msgs::PointCloud2ConstPtr& pc_msg) {
+    StageDiagnostics& diagnostics = *diagnostics_;
+    const auto start = std::chrono::steady_clock::now();
+    const ros::Time receipt = ros::Time::now();
+    diagnostics.recordAge(kStageAgeIn, pc_msg->header.stamp, receipt);
+    diagnostics.count(kCounterDropped, input_gap_.update(pc_msg->header.seq));
+    // With a queue of 1 the surviving cloud can still be old when the CPU is busy, the
+    // detection stage is better off without it
+    if (!pc_msg->header.stamp.isZero() &&
+        governor_.stale(static_cast<int64_t>((receipt - pc_msg->header.stamp).toNSec()))) {
+        diagnostics.count(kCounterStale);
+        ROS_DEBUG_THROTTLE(1.0, "Dropping a cloud %.3f s old", (receipt - pc_msg->header.stamp).toSec());
+        return;
+    }
+    ScopedStageTimer callback_timer(diagnostics[kStageCallback]);
+    Eigen::Matrix<float, 3, 4> world_to_hires;
+    std::string tf_error;
+    if (!transform_cache_->lookup("hires", pc_msg->header.frame_id, world_to_hires, &tf_error)) {
+        ROS_WARN("Failure, I am here %s\n", tf_error.c_str());
+        return;
+    }
+    ROS_DEBUG_THROTTLE(5.0, "Transform cache hits: %lu misses: %lu changes: %lu",
+                       transform_cache_->hits(), transform_cache_->misses(), transform_cache_->changes());
+    // Goes back to the pool on return unless a subscriber still holds it
+    const sensor_msgs::PointCloud2Ptr transformed_pc = output_pool_->acquire();
+    diagnostics.setPoolGauges(kCounterOutputPool, output_pool_->stats());
+    if (!processor_->process(*pc_msg, world_to_hires, *transformed_pc)) {
+        ROS_WARN_THROTTLE(1.0, "Point cloud on /tof_pc has no float32 x, y, z fields, skipping");
+        return;
+    }
+    // Published by pointer so subscribers in the same nodelet manager get the message
+    // itself, without serialization or copy
+    {
+        ScopedStageTimer timer(diagnostics[kStagePublish]);
+        pc_pub_.publish(transformed_pc);
+    }
+    diagnostics.recordAge(kStageAgeOut, pc_msg->header.stamp, ros::Time::now());
+    if (governor_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count())) {
+        processor_->setQualityLevel(governor_.level());
+        ROS_INFO("Transform quality level %d of %d", governor_.level(), governor_.config().max_level);
+        std_msgs::UInt8 level;
+        level.data = static_cast<uint8_t>(governor_.level());
+        level_pub_.publish(level);
+    }
+    diagnostics.set(kCounterQualityLevel, static_cast<uint64_t>(governor_.level()));
+}
+
+}  // namespace your_pointcloud_package
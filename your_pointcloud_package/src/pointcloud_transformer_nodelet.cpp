@@ -0,0 +1,32 @@
+/**
+ * @file pointcloud_transformer_nodelet.cpp
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Nodelet wrapper around PointCloudTransformer so the transformed cloud can be
+ * handed to the detection nodelet by pointer
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <your_pointcloud_package/pointcloud_transformer.h>
+
+#include <memory>
+
+namespace your_pointcloud_package {
+
+class PointCloudTransformerNodelet : public nodelet::Nodelet {
+private:
+    void onInit() override {
+        transformer_.reset(new PointCloudTransformer(getNodeHandle(), getPrivateNodeHandle()));
+    }
+
+    std::unique_ptr<PointCloudTransformer> transformer_;
+};
+
+}  // namespace your_pointcloud_package
+
+PLUGINLIB_EXPORT_CLASS(your_pointcloud_package::PointCloudTransformerNodelet, nodelet::Nodelet)
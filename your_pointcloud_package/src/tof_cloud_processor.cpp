@@ -0,0 +1,116 @@
+/**
+ * @file tof_cloud_processor.cpp
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Implementation of the ToF filter, transform and downsample step
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <your_pointcloud_package/tof_cloud_processor.h>
+#include <your_pointcloud_package/point_cloud2_layout.h>
+#include <your_pointcloud_package/tiled_filter_transform.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
+
+namespace your_pointcloud_package {
+
+using pipeline_diagnostics::ScopedStageTimer;
+using pipeline_diagnostics::StageStats;
+
+TofCloudProcessor::TofCloudProcessor(const TofCloudConfig& config, StageStats& stats)
+    : config_(config), stats_(stats), max_points_(config.max_points),
+      voxel_leaf_(static_cast<float>(config.voxel_size)) {
+    if (config_.downsample == DownsampleMode::kVoxel) {
+        voxel_grid_.reset(new VoxelGrid(kTofMaxPoints));
+    }
+    ROS_INFO("Downsampling: %s, budget %d points", downsampleModeName(config_.downsample), config_.max_points);
+    if (!config_.worker_cpus.empty()) {
+        pool_.reset(new WorkerPool(config_.worker_cpus));
+        if (pool_->pinFailures() > 0) {
+            ROS_WARN("%zu transform workers could not be pinned to their core", pool_->pinFailures());
+        }
+    }
+    tile_counts_.reserve((kTofMaxPoints + config_.tile_points - 1) / config_.tile_points);
+    filter_scratch_.resize(kTofMaxPoints * kOutputPointStep);
+}
+
+void TofCloudProcessor::initOutput(sensor_msgs::PointCloud2& msg) {
+    sensor_msgs::PointCloud2Modifier modifier(msg);
+    modifier.setPointCloud2Fields(3,
+        "x", 1, sensor_msgs::PointField::FLOAT32,
+        "y", 1, sensor_msgs::PointField::FLOAT32,
+        "z", 1, sensor_msgs::PointField::FLOAT32);
+    msg.point_step = kOutputPointStep;
+    msg.header.frame_id = "hires";
+    msg.height = 1;
+    msg.is_bigendian = false;
+    msg.is_dense = true;
+    msg.data.reserve(kTofMaxPoints * kOutputPointStep);
+}
+
+void TofCloudProcessor::setQualityLevel(int level) {
+    const TofGate full_gate;
+    if (level <= 0) {
+        max_points_ = config_.max_points;
+        tof_gate_ = full_gate;
+        return;
+    }
+    const int full_budget = config_.max_points > 0 ? config_.max_points : static_cast<int>(kTofMaxPoints);
+    max_points_ = std::max(full_budget >> std::min(level, 16), 1);
+    // The gate keeps at least 10 cm of depth
+    tof_gate_.z_max = std::max(full_gate.z_max - static_cast<float>(level * config_.z_step), full_gate.z_min + 0.1f);
+}
+
+bool TofCloudProcessor::process(const sensor_msgs::PointCloud2& in, const Eigen::Matrix<float, 3, 4>& world_to_hires,
+                                sensor_msgs::PointCloud2& out) {
+    CloudLayout layout;
+    bool layout_ok;
+    {
+        ScopedStageTimer timer(stats_[kStageLayout]);
+        layout_ok = resolveCloudLayout(in, layout);
+    }
+    if (!layout_ok) {
+        return false;
+    }
+    if (pointFormat(layout) != input_format_) {
+        input_format_ = pointFormat(layout);
+        ROS_INFO("Reading /tof_pc as %s", pointFormatName(input_format_));
+    }
+    world_to_hires_.set(world_to_hires);
+    if (config_.downsample == DownsampleMode::kStride) {
+        // Skipped pixels are never read, the stride grows until the view fits the budget
+        layout = stridedLayout(layout, strideForBudget(layout, config_.stride, max_points_));
+    }
+    // The survivors are appended to the message buffer, inside the capacity initOutput
+    // reserved, and the downsampling trims it in place. Resizing it up to the whole frame
+    // instead would zero fill what the last frame trimmed off.
+    size_t n_out;
+    {
+        // Filter and transform are one fused pass, they share a timer
+        ScopedStageTimer timer(stats_[kStageFilterTransform]);
+        n_out = filterTransformTiled(pool_.get(), tile_counts_, config_.tile_points, config_.parallel_min_points,
+                                     in.data.data(), layout, world_to_hires_, tof_gate_, filter_scratch_, out.data);
+    }
+    if (config_.downsample == DownsampleMode::kVoxel || max_points_ > 0) {
+        ScopedStageTimer timer(stats_[kStageDownsample]);
+        if (config_.downsample == DownsampleMode::kVoxel) {
+            n_out = voxel_grid_->downsample(out.data.data(), n_out, voxel_leaf_);
+            voxel_leaf_ = adaptVoxelLeaf(voxel_leaf_, static_cast<float>(config_.voxel_size), n_out, max_points_);
+        }
+        n_out = thinPoints(out.data.data(), n_out, max_points_);
+    }
+    out.data.resize(n_out * kOutputPointStep);
+    // Print the size of the cloud_filtered point cloud
+    ROS_DEBUG("Size of the filtered point cloud: %ld", n_out);
+    out.header.stamp = in.header.stamp;
+    // Handed over by pointer the message keeps its seq, so the detection stage sees the
+    // gaps of /tof_pc too
+    out.header.seq = in.header.seq;
+    out.width = n_out;
+    out.row_step = n_out * kOutputPointStep;
+    return true;
+}
+
+}  // namespace your_pointcloud_package
@@ -0,0 +1,192 @@
+/**
+ * @file kernel_test.cpp
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Checks the ROS free kernels of the transform stage against naive references on
+ * a few fixed clouds: the filter and transform, its tiled driver and the voxel grid.
+ * Every cloud is written with both packed layouts and a generic one, so the specialized
+ * field readers are covered too.
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "test_clouds.h"
+
+#include <gtest/gtest.h>
+#include <your_pointcloud_package/cloud_downsample.h>
+#include <your_pointcloud_package/tiled_filter_transform.h>
+#include <your_pointcloud_package/tof_filter_transform.h>
+
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <tuple>
+#include <vector>
+
+namespace your_pointcloud_package {
+
+namespace {
+
+using test::Cloud;
+using test::Placement;
+using test::kPlacements;
+using test::kSceneWidth;
+using test::makeCloud;
+using test::sceneTofPoints;
+using test::tofToHires;
+
+/**
+ * @brief The points filterTransformTof should keep, in the hires frame
+ *
+ */
+std::vector<Eigen::Vector3f> naiveFilterTransform(const std::vector<Eigen::Vector3f>& points,
+                                                  const Eigen::Matrix<float, 3, 4>& T, const TofGate& gate) {
+    std::vector<Eigen::Vector3f> kept;
+    for (const Eigen::Vector3f& p : points) {
+        if (isFiniteBits(p.x()) && isFiniteBits(p.y()) && isFiniteBits(p.z()) && p.z() >= gate.z_min &&
+            p.z() <= gate.z_max) {
+            kept.push_back(T.leftCols<3>() * p + T.col(3));
+        }
+    }
+    return kept;
+}
+
+void expectOutput(const uint8_t* out, size_t n, const std::vector<Eigen::Vector3f>& expected) {
+    ASSERT_EQ(n, expected.size());
+    for (size_t i = 0; i < n; ++i) {
+        float p[4];
+        std::memcpy(p, out + i * kOutputPointStep, sizeof(p));
+        EXPECT_LT((Eigen::Vector3f(p[0], p[1], p[2]) - expected[i]).cwiseAbs().maxCoeff(), 1e-5f) << "point " << i;
+        EXPECT_EQ(p[3], 1.0f);
+    }
+}
+
+/**
+ * @brief Writes the points as the packed kernel output, padding lane 1
+ *
+ */
+std::vector<uint8_t> packPoints(const std::vector<Eigen::Vector3f>& points) {
+    std::vector<uint8_t> packed(points.size() * kOutputPointStep);
+    for (size_t i = 0; i < points.size(); ++i) {
+        const float point[4] = {points[i].x(), points[i].y(), points[i].z(), 1.0f};
+        std::memcpy(packed.data() + i * kOutputPointStep, point, sizeof(point));
+    }
+    return packed;
+}
+
+/**
+ * @brief Centroids of the occupied voxels in first hit order
+ *
+ */
+std::vector<Eigen::Vector3f> naiveVoxels(const std::vector<Eigen::Vector3f>& points, float leaf) {
+    const float inv_leaf = 1.0f / leaf;
+    std::map<std::tuple<int, int, int>, size_t> index;
+    std::vector<Eigen::Vector3d> sums;
+    std::vector<size_t> counts;
+    for (const Eigen::Vector3f& p : points) {
+        const auto key = std::make_tuple(static_cast<int>(std::floor(p.x() * inv_leaf)),
+                                         static_cast<int>(std::floor(p.y() * inv_leaf)),
+                                         static_cast<int>(std::floor(p.z() * inv_leaf)));
+        const auto it = index.emplace(key, sums.size()).first;
+        if (it->second == sums.size()) {
+            sums.push_back(Eigen::Vector3d::Zero());
+            counts.push_back(0);
+        }
+        sums[it->second] += p.cast<double>();
+        ++counts[it->second];
+    }
+    std::vector<Eigen::Vector3f> centroids;
+    for (size_t k = 0; k < sums.size(); ++k) {
+        centroids.push_back((sums[k] / static_cast<double>(counts[k])).cast<float>());
+    }
+    return centroids;
+}
+
+void expectVoxels(VoxelGrid& grid, const std::vector<Eigen::Vector3f>& points, float leaf) {
+    std::vector<uint8_t> packed = packPoints(points);
+    const std::vector<Eigen::Vector3f> expected = naiveVoxels(points, leaf);
+    const size_t n = grid.downsample(packed.data(), points.size(), leaf);
+    ASSERT_EQ(n, expected.size());
+    for (size_t k = 0; k < n; ++k) {
+        float centroid[4];
+        std::memcpy(centroid, packed.data() + k * kOutputPointStep, sizeof(centroid));
+        EXPECT_LT((Eigen::Vector3f(centroid[0], centroid[1], centroid[2]) - expected[k]).cwiseAbs().maxCoeff(), 1e-5f)
+            << "voxel " << k;
+        EXPECT_EQ(centroid[3], 1.0f);
+    }
+}
+
+}  // namespace
+
+TEST(FilterTransformTof, MatchesNaiveFilterOnEveryLayout) {
+    const std::vector<Eigen::Vector3f> points = sceneTofPoints();
+    const TofGate gate;
+    const std::vector<Eigen::Vector3f> expected = naiveFilterTransform(points, tofToHires(), gate);
+    for (Placement placement : kPlacements) {
+        const Cloud cloud = makeCloud(points, kSceneWidth, placement);
+        // Split in the middle of a row to cover the partial rows of a tile
+        std::vector<uint8_t> out(points.size() * kOutputPointStep);
+        const size_t split = 5 * kSceneWidth + 7;
+        size_t n = filterTransformTof(cloud.data.data(), cloud.layout, 0, split, PacketTransform(tofToHires()), gate,
+                                      out.data());
+        n += filterTransformTof(cloud.data.data(), cloud.layout, split, points.size(), PacketTransform(tofToHires()),
+                                gate, out.data() + n * kOutputPointStep);
+        expectOutput(out.data(), n, expected);
+    }
+}
+
+TEST(FilterTransformTiled, AppendsTheSurvivorsInOrder) {
+    const std::vector<Eigen::Vector3f> points = sceneTofPoints();
+    const TofGate gate;
+    const std::vector<Eigen::Vector3f> expected = naiveFilterTransform(points, tofToHires(), gate);
+    // Two unpinned workers besides the caller
+    WorkerPool pool(std::vector<int>(2, 0));
+    std::vector<size_t> tile_counts;
+    for (Placement placement : kPlacements) {
+        const Cloud cloud = makeCloud(points, kSceneWidth, placement);
+        for (WorkerPool* tile_pool : {static_cast<WorkerPool*>(nullptr), &pool}) {
+            SCOPED_TRACE(tile_pool != nullptr ? "pool" : "serial");
+            // out still holds a longer cloud, scratch starts too small
+            std::vector<uint8_t> scratch;
+            std::vector<uint8_t> out(2 * points.size() * kOutputPointStep, 0xff);
+            // 100 points per tile, the tiles end in the middle of a row
+            const size_t n = filterTransformTiled(tile_pool, tile_counts, 100, 0, cloud.data.data(), cloud.layout,
+                                                  PacketTransform(tofToHires()), gate, scratch, out);
+            ASSERT_EQ(out.size(), n * kOutputPointStep);
+            expectOutput(out.data(), n, expected);
+        }
+    }
+}
+
+TEST(VoxelGrid, MatchesNaiveVoxelCentroids) {
+    // The filtered scene in the hires frame, as the transform stage hands it over
+    const std::vector<Eigen::Vector3f> raw = sceneTofPoints();
+    const Cloud cloud = makeCloud(raw, kSceneWidth, Placement::kPacked12);
+    std::vector<uint8_t> filtered(raw.size() * kOutputPointStep);
+    const size_t n = filterTransformTof(cloud.data.data(), cloud.layout, 0, raw.size(), PacketTransform(tofToHires()),
+                                        TofGate(), filtered.data());
+    std::vector<Eigen::Vector3f> points;
+    for (size_t i = 0; i < n; ++i) {
+        float p[4];
+        std::memcpy(p, filtered.data() + i * kOutputPointStep, sizeof(p));
+        points.emplace_back(p[0], p[1], p[2]);
+    }
+    VoxelGrid grid(points.size());
+    // Twice on the same grid, the table has to come back empty after a frame
+    for (int frame = 0; frame < 2; ++frame) {
+        expectVoxels(grid, points, 0.05f);
+    }
+    expectVoxels(grid, points, 0.013f);
+}
+
+TEST(VoxelGrid, EdgeCases) {
+    VoxelGrid grid(64);
+    expectVoxels(grid, {}, 0.05f);
+    expectVoxels(grid, {Eigen::Vector3f(-0.31f, 0.12f, 0.9f)}, 0.05f);
+    // All points in one voxel, on the negative side of the origin
+    expectVoxels(grid, test::blob(Eigen::Vector3f(-0.125f, -0.075f, 0.825f), 0.02f, 40, 3), 0.05f);
+}
+
+}  // namespace your_pointcloud_package
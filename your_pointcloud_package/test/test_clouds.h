@@ -0,0 +1,156 @@
+/**
+ * @file test_clouds.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Small synthetic clouds for the kernel tests: a ToF frame written with the
+ * packed layouts and a generic one, the ToF to hires transform and deterministic blobs
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef YOUR_POINTCLOUD_PACKAGE_TEST_CLOUDS_H
+#define YOUR_POINTCLOUD_PACKAGE_TEST_CLOUDS_H
+
+#include <your_pointcloud_package/tof_filter_transform.h>
+#include <Eigen/Geometry>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace your_pointcloud_package {
+namespace test {
+
+struct Cloud {
+    CloudLayout layout;
+    std::vector<uint8_t> data;
+};
+
+/**
+ * @brief How the x, y, z fields are laid out in a test cloud: the two packed formats
+ * the kernels are specialized for, and shuffled fields in 20 byte points with padded
+ * rows, which goes through RuntimeFields
+ *
+ */
+enum class Placement {
+    kPacked12,
+    kPacked16,
+    kShuffled,
+};
+
+const Placement kPlacements[] = {Placement::kPacked12, Placement::kPacked16, Placement::kShuffled};
+
+/**
+ * @brief Organized cloud of the points, row major with width points per row. The bytes
+ * that are not x, y or z are NaN patterns, a kernel reading them fails the comparison.
+ *
+ */
+inline Cloud makeCloud(const std::vector<Eigen::Vector3f>& points, uint32_t width, Placement placement) {
+    Cloud cloud;
+    CloudLayout& layout = cloud.layout;
+    uint32_t row_padding = 0;
+    switch (placement) {
+        case Placement::kPacked12:
+            layout.point_step = 12;
+            break;
+        case Placement::kPacked16:
+            layout.point_step = 16;
+            break;
+        case Placement::kShuffled:
+            layout.offset_x = 8;
+            layout.offset_y = 12;
+            layout.offset_z = 0;
+            layout.point_step = 20;
+            row_padding = 24;
+            break;
+    }
+    layout.width = width;
+    layout.height = width > 0 ? static_cast<uint32_t>(points.size() / width) : 0;
+    layout.row_step = width * layout.point_step + row_padding;
+    cloud.data.assign(static_cast<size_t>(layout.row_step) * layout.height, 0xff);
+    for (size_t i = 0; i < layout.size(); ++i) {
+        uint8_t* p = cloud.data.data() + (i / width) * layout.row_step + (i % width) * layout.point_step;
+        std::memcpy(p + layout.offset_x, &points[i].x(), sizeof(float));
+        std::memcpy(p + layout.offset_y, &points[i].y(), sizeof(float));
+        std::memcpy(p + layout.offset_z, &points[i].z(), sizeof(float));
+    }
+    return cloud;
+}
+
+inline Eigen::Vector3f loadPoint(const Cloud& cloud, size_t row, size_t col) {
+    const CloudLayout& layout = cloud.layout;
+    const uint8_t* p = cloud.data.data() + row * layout.row_step + col * layout.point_step;
+    Eigen::Vector3f point;
+    std::memcpy(&point.x(), p + layout.offset_x, sizeof(float));
+    std::memcpy(&point.y(), p + layout.offset_y, sizeof(float));
+    std::memcpy(&point.z(), p + layout.offset_z, sizeof(float));
+    return point;
+}
+
+constexpr uint32_t kSceneWidth = 32;
+constexpr uint32_t kSceneHeight = 24;
+
+/**
+ * @brief 32 x 24 ToF frame of a wall 1.3 m away with a target at 0.8 m in the middle.
+ * The corners are beyond the z gate, a few pixels have no return (all zero) or are NaN.
+ *
+ */
+inline std::vector<Eigen::Vector3f> sceneTofPoints() {
+    constexpr float kFx = 16.0f;
+    std::vector<Eigen::Vector3f> points;
+    for (uint32_t v = 0; v < kSceneHeight; ++v) {
+        for (uint32_t u = 0; u < kSceneWidth; ++u) {
+            const float du = u - kSceneWidth / 2.0f + 0.5f;
+            const float dv = v - kSceneHeight / 2.0f + 0.5f;
+            float z = std::abs(du) < 6.0f && std::abs(dv) < 5.0f ? 0.8f + 0.002f * (u % 3) : 1.3f + 0.004f * (v % 4);
+            if (std::abs(du) > 13.0f && std::abs(dv) > 9.0f) {
+                z = 2.0f;
+            }
+            const size_t k = v * kSceneWidth + u;
+            if (k % 23 == 5) {
+                points.emplace_back(0.0f, 0.0f, 0.0f);
+            } else if (k % 37 == 7) {
+                points.emplace_back(Eigen::Vector3f::Constant(std::numeric_limits<float>::quiet_NaN()));
+            } else {
+                points.emplace_back(du * z / kFx, dv * z / kFx, z);
+            }
+        }
+    }
+    return points;
+}
+
+inline Eigen::Matrix<float, 3, 4> tofToHires() {
+    Eigen::Matrix<float, 3, 4> T;
+    T.leftCols<3>() = Eigen::AngleAxisf(0.02f, Eigen::Vector3f::UnitY()).toRotationMatrix();
+    T.col(3) = Eigen::Vector3f(0.025f, -0.012f, 0.004f);
+    return T;
+}
+
+/**
+ * @brief Deterministic points in a cube of the given half size around center
+ *
+ */
+inline std::vector<Eigen::Vector3f> blob(const Eigen::Vector3f& center, float half_size, size_t n, uint32_t seed) {
+    std::vector<Eigen::Vector3f> points;
+    uint32_t state = seed;
+    const auto next = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) / static_cast<float>(1u << 24) * 2.0f - 1.0f;
+    };
+    for (size_t i = 0; i < n; ++i) {
+        const float x = next();
+        const float y = next();
+        const float z = next();
+        points.push_back(center + half_size * Eigen::Vector3f(x, y, z));
+    }
+    return points;
+}
+
+}  // namespace test
+}  // namespace your_pointcloud_package
+
+#endif  // YOUR_POINTCLOUD_PACKAGE_TEST_CLOUDS_H
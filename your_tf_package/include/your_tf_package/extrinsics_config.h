@@ -0,0 +1,332 @@
+/**
+ * @file extrinsics_config.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Reads the camera extrinsics from a VOXL style extrinsics.conf: JSON with #
+ * comments and trailing commas, either a list of extrinsics or an object holding it
+ * under "extrinsics"
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef YOUR_TF_PACKAGE_EXTRINSICS_CONFIG_H
+#define YOUR_TF_PACKAGE_EXTRINSICS_CONFIG_H
+
+#include <Eigen/Geometry>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace your_tf_package {
+
+struct ExtrinsicTransform {
+    std::string parent;
+    std::string child;
+    std::array<double, 3> T_child_wrt_parent;
+    // Degrees, applied as roll about x, then pitch about y, then yaw about z
+    std::array<double, 3> RPY_parent_to_child;
+
+    bool operator==(const ExtrinsicTransform& other) const {
+        return parent == other.parent && child == other.child && T_child_wrt_parent == other.T_child_wrt_parent &&
+               RPY_parent_to_child == other.RPY_parent_to_child;
+    }
+    bool operator!=(const ExtrinsicTransform& other) const { return !(*this == other); }
+};
+
+/**
+ * @brief Rotation of the child frame in the parent frame, Rx(roll) * Ry(pitch) * Rz(yaw)
+ *
+ */
+inline Eigen::Quaterniond extrinsicRotation(const ExtrinsicTransform& extrinsic) {
+    const double deg = M_PI / 180.0;
+    return Eigen::Quaterniond(Eigen::AngleAxisd(extrinsic.RPY_parent_to_child[0] * deg, Eigen::Vector3d::UnitX()) *
+                              Eigen::AngleAxisd(extrinsic.RPY_parent_to_child[1] * deg, Eigen::Vector3d::UnitY()) *
+                              Eigen::AngleAxisd(extrinsic.RPY_parent_to_child[2] * deg, Eigen::Vector3d::UnitZ()));
+}
+
+namespace detail {
+
+/**
+ * @brief Recursive descent over the subset of JSON the VOXL tools write
+ *
+ */
+class ExtrinsicsParser {
+public:
+    explicit ExtrinsicsParser(const std::string& text) : text_(text) {}
+
+    bool parse(std::vector<ExtrinsicTransform>& extrinsics) {
+        extrinsics.clear();
+        skipSpace();
+        if (peek() == '{') {
+            // {"name": ..., "extrinsics": [...]}
+            bool found = false;
+            if (!parseObject([&](const std::string& key) {
+                    if (key == "extrinsics") {
+                        found = true;
+                        return parseList(extrinsics);
+                    }
+                    return skipValue();
+                })) {
+                return false;
+            }
+            if (!found) {
+                return fail("no \"extrinsics\" list");
+            }
+        } else if (!parseList(extrinsics)) {
+            return false;
+        }
+        skipSpace();
+        if (pos_ != text_.size()) {
+            return fail("unexpected text after the extrinsics");
+        }
+        return true;
+    }
+
+    const std::string& error() const { return error_; }
+
+private:
+    bool parseList(std::vector<ExtrinsicTransform>& extrinsics) {
+        if (!expect('[')) {
+            return false;
+        }
+        std::set<std::string> children;
+        while (true) {
+            skipSpace();
+            if (peek() == ']') {
+                ++pos_;
+                return true;
+            }
+            ExtrinsicTransform extrinsic;
+            if (!parseExtrinsic(extrinsic)) {
+                return false;
+            }
+            // Every frame of a tf tree has a single parent
+            if (!children.insert(extrinsic.child).second) {
+                return fail("frame \"" + extrinsic.child + "\" has more than one parent");
+            }
+            extrinsics.push_back(extrinsic);
+            if (!separator(']')) {
+                return false;
+            }
+        }
+    }
+
+    bool parseExtrinsic(ExtrinsicTransform& extrinsic) {
+        int found = 0;
+        if (!parseObject([&](const std::string& key) {
+                if (key == "parent") { found |= 1; return parseString(extrinsic.parent); }
+                if (key == "child") { found |= 2; return parseString(extrinsic.child); }
+                if (key == "T_child_wrt_parent") { found |= 4; return parseVector(extrinsic.T_child_wrt_parent); }
+                if (key == "RPY_parent_to_child") { found |= 8; return parseVector(extrinsic.RPY_parent_to_child); }
+                return skipValue();
+            })) {
+            return false;
+        }
+        if (found != 15) {
+            return fail("extrinsic needs parent, child, T_child_wrt_parent and RPY_parent_to_child");
+        }
+        if (extrinsic.parent.empty() || extrinsic.child.empty() || extrinsic.parent == extrinsic.child) {
+            return fail("extrinsic needs two different, non empty frame names");
+        }
+        return true;
+    }
+
+    /**
+     * @brief Calls on_key for every key, on_key has to consume the value
+     *
+     */
+    template <typename OnKey>
+    bool parseObject(OnKey&& on_key) {
+        if (!expect('{')) {
+            return false;
+        }
+        while (true) {
+            skipSpace();
+            if (peek() == '}') {
+                ++pos_;
+                return true;
+            }
+            std::string key;
+            if (!parseString(key) || !expect(':') || !on_key(key) || !separator('}')) {
+                return false;
+            }
+        }
+    }
+
+    bool parseVector(std::array<double, 3>& values) {
+        if (!expect('[')) {
+            return false;
+        }
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (!parseNumber(values[i]) || (i + 1 < values.size() && !expect(','))) {
+                return false;
+            }
+        }
+        skipSpace();
+        if (peek() == ',') {
+            ++pos_;
+        }
+        return expect(']');
+    }
+
+    bool parseString(std::string& value) {
+        if (!expect('"')) {
+            return false;
+        }
+        const size_t end = text_.find('"', pos_);
+        if (end == std::string::npos) {
+            return fail("unterminated string");
+        }
+        value = text_.substr(pos_, end - pos_);
+        pos_ = end + 1;
+        return true;
+    }
+
+    bool parseNumber(double& value) {
+        skipSpace();
+        const char* start = text_.c_str() + pos_;
+        char* end = nullptr;
+        value = std::strtod(start, &end);
+        if (end == start || !std::isfinite(value)) {
+            return fail("expected a number");
+        }
+        pos_ += end - start;
+        return true;
+    }
+
+    bool skipValue() {
+        skipSpace();
+        const char c = peek();
+        if (c == '"') {
+            std::string ignored;
+            return parseString(ignored);
+        }
+        if (c == '{') {
+            return parseObject([&](const std::string&) { return skipValue(); });
+        }
+        if (c == '[') {
+            ++pos_;
+            while (true) {
+                skipSpace();
+                if (peek() == ']') {
+                    ++pos_;
+                    return true;
+                }
+                if (!skipValue() || !separator(']')) {
+                    return false;
+                }
+            }
+        }
+        // Numbers, true, false and null
+        const size_t start = pos_;
+        while (pos_ < text_.size() && (std::isalnum(static_cast<unsigned char>(text_[pos_])) ||
+                                       text_[pos_] == '-' || text_[pos_] == '+' || text_[pos_] == '.')) {
+            ++pos_;
+        }
+        return pos_ != start || fail("expected a value");
+    }
+
+    /**
+     * @brief Consumes the comma after a member, a trailing comma before close included
+     *
+     */
+    bool separator(char close) {
+        skipSpace();
+        if (peek() == ',') {
+            ++pos_;
+            return true;
+        }
+        if (peek() == close) {
+            return true;
+        }
+        return fail(std::string("expected ',' or '") + close + "'");
+    }
+
+    bool expect(char c) {
+        skipSpace();
+        if (peek() != c) {
+            return fail(std::string("expected '") + c + "'");
+        }
+        ++pos_;
+        return true;
+    }
+
+    void skipSpace() {
+        while (pos_ < text_.size()) {
+            if (text_[pos_] == '#') {
+                const size_t end = text_.find('\n', pos_);
+                pos_ = end == std::string::npos ? text_.size() : end;
+            } else if (std::isspace(static_cast<unsigned char>(text_[pos_]))) {
+                ++pos_;
+            } else {
+                break;
+            }
+        }
+    }
+
+    char peek() const { return pos_ < text_.size() ? text_[pos_] : '\0'; }
+
+    bool fail(const std::string& what) {
+        if (error_.empty()) {
+            const size_t line = 1 + std::count(text_.begin(), text_.begin() + std::min(pos_, text_.size()), '\n');
+            error_ = "line " + std::to_string(line) + ": " + what;
+        }
+        return false;
+    }
+
+    const std::string& text_;
+    size_t pos_ = 0;
+    std::string error_;
+};
+
+}  // namespace detail
+
+/**
+ * @brief Parses the text of an extrinsics file
+ *
+ * @param error Set to the reason when parsing fails, may be null
+ * @return false on a syntax error, a missing field or a frame with two parents
+ */
+inline bool parseExtrinsics(const std::string& text, std::vector<ExtrinsicTransform>& extrinsics,
+                            std::string* error = nullptr) {
+    detail::ExtrinsicsParser parser(text);
+    if (!parser.parse(extrinsics)) {
+        if (error != nullptr) {
+            *error = parser.error();
+        }
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads and parses an extrinsics file, see parseExtrinsics
+ *
+ */
+inline bool loadExtrinsics(const std::string& path, std::vector<ExtrinsicTransform>& extrinsics,
+                           std::string* error = nullptr) {
+    std::ifstream file(path);
+    if (!file) {
+        if (error != nullptr) {
+            *error = "cannot open " + path;
+        }
+        return false;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    return parseExtrinsics(text.str(), extrinsics, error);
+}
+
+}  // namespace your_tf_package
+
+#endif  // YOUR_TF_PACKAGE_EXTRINSICS_CONFIG_H
@@ -0,0 +1,125 @@
+/**
+ * @file file_watcher.h
+ * @author Darshit Desai (darshit@umd.edu)
+ * @brief Calls back when a file is written or replaced, through inotify, so the watching
+ * thread sleeps in the kernel instead of polling
+ * @version 0.1
+ * @date 2024-03-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#ifndef YOUR_TF_PACKAGE_FILE_WATCHER_H
+#define YOUR_TF_PACKAGE_FILE_WATCHER_H
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace your_tf_package {
+
+/**
+ * @brief Watches the directory of the file rather than the file itself: editors and
+ * config tools save by writing a new file and renaming it over the old one, which a
+ * watch on the old inode never sees. Events are only raised once the writer closed the
+ * file or moved it in place, so the callback never reads a half written file.
+ *
+ */
+class FileWatcher {
+public:
+    /**
+     * @param path File to watch, its directory must exist
+     * @param on_change Called on the watcher thread after every change
+     * @throws std::runtime_error if the watch cannot be set up
+     */
+    FileWatcher(const std::string& path, std::function<void()> on_change) : on_change_(std::move(on_change)) {
+        const size_t slash = path.find_last_of('/');
+        const std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+        name_ = slash == std::string::npos ? path : path.substr(slash + 1);
+        inotify_fd_ = inotify_init1(IN_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_CLOEXEC);
+        if (inotify_fd_ < 0 || wake_fd_ < 0 ||
+            inotify_add_watch(inotify_fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            const std::string reason = std::strerror(errno);
+            closeFds();
+            throw std::runtime_error("Cannot watch " + dir + ": " + reason);
+        }
+        thread_ = std::thread(&FileWatcher::run, this);
+    }
+
+    ~FileWatcher() {
+        const uint64_t one = 1;
+        if (write(wake_fd_, &one, sizeof(one)) != sizeof(one)) {
+            // The thread is blocked in poll and would never return, nothing sane to do
+            std::terminate();
+        }
+        thread_.join();
+        closeFds();
+    }
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+private:
+    void run() {
+        alignas(struct inotify_event) char buffer[4096];
+        pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+        while (true) {
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+            if (fds[1].revents != 0) {
+                return;
+            }
+            const ssize_t length = read(inotify_fd_, buffer, sizeof(buffer));
+            if (length <= 0) {
+                continue;
+            }
+            bool changed = false;
+            for (ssize_t offset = 0; offset < length;) {
+                const auto* event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+                if (event->len > 0 && name_ == event->name && (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))) {
+                    changed = true;
+                }
+                offset += sizeof(struct inotify_event) + event->len;
+            }
+            if (changed) {
+                on_change_();
+            }
+        }
+    }
+
+    void closeFds() {
+        if (inotify_fd_ >= 0) {
+            close(inotify_fd_);
+        }
+        if (wake_fd_ >= 0) {
+            close(wake_fd_);
+        }
+    }
+
+    std::function<void()> on_change_;
+    std::string name_;
+    int inotify_fd_ = -1;
+    int wake_fd_ = -1;
+    std::thread thread_;
+};
+
+}  // namespace your_tf_package
+
+#endif  // YOUR_TF_PACKAGE_FILE_WATCHER_H
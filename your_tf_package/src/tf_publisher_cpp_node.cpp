@@ -4,72 +4,123 @@
  * @brief The following cpp file is the ros node for publishing the static transforms based on the given camera extrinsics of the drone in the form of a .conf file
  * @version 0.1
  * @date 2024-02-28
- * 
+ *
  * @copyright Copyright (c) 2024
- * 
+ *
  */
 
 #include <ros/ros.h>
 #include <tf2_ros/static_transform_broadcaster.h>
 #include <geometry_msgs/TransformStamped.h>
-#include <tf2/LinearMath/Quaternion.h>
-#include <Eigen/Geometry>
+#include <your_tf_package/extrinsics_config.h>
+#include <your_tf_package/file_watcher.h>
 
-struct ExtrinsicTransform {
-    std::string parent;
-    std::string child;
-    std::vector<double> T_child_wrt_parent;
-    std::vector<double> RPY_parent_to_child;
-};
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using your_tf_package::ExtrinsicTransform;
 
-void publish_static_transforms() {
-    // Create a static transform broadcaster
-    static tf2_ros::StaticTransformBroadcaster static_broadcaster;
-    std::vector<ExtrinsicTransform> extrinsics = {
-        {"body", "world", {0.068, 0.0116, 0.0168}, {0, 270, 0}},
-        {"body", "hires", {0.068, -0.012, 0.015}, {90, 270, 0}}
-    };
+geometry_msgs::TransformStamped toTransformStamped(const ExtrinsicTransform& extrinsic, const ros::Time& stamp) {
+    geometry_msgs::TransformStamped static_transform;
+    static_transform.header.stamp = stamp;
+    static_transform.header.frame_id = extrinsic.parent;
+    static_transform.child_frame_id = extrinsic.child;
+    static_transform.transform.translation.x = extrinsic.T_child_wrt_parent[0];
+    static_transform.transform.translation.y = extrinsic.T_child_wrt_parent[1];
+    static_transform.transform.translation.z = extrinsic.T_child_wrt_parent[2];
+    const Eigen::Quaterniond q = your_tf_package::extrinsicRotation(extrinsic);
+    static_transform.transform.rotation.x = q.x();
+    static_transform.transform.rotation.y = q.y();
+    static_transform.transform.rotation.z = q.z();
+    static_transform.transform.rotation.w = q.w();
+    return static_transform;
+}
 
-    // Publish the static transforms
-    std::vector<geometry_msgs::TransformStamped> static_transforms;
-    for (const auto& extrinsic : extrinsics) {
-        geometry_msgs::TransformStamped static_transform;
-        static_transform.header.stamp = ros::Time::now();
-        static_transform.header.frame_id = extrinsic.parent;
-        static_transform.child_frame_id = extrinsic.child;
-        static_transform.transform.translation.x = extrinsic.T_child_wrt_parent[0];
-        static_transform.transform.translation.y = extrinsic.T_child_wrt_parent[1];
-        static_transform.transform.translation.z = extrinsic.T_child_wrt_parent[2];
-        double roll = extrinsic.RPY_parent_to_child[0];
-        double pitch = extrinsic.RPY_parent_to_child[1];
-        double yaw = extrinsic.RPY_parent_to_child[2];
-        double roll_rad = roll * M_PI / 180;
-        double pitch_rad = pitch * M_PI / 180;
-        double yaw_rad = yaw * M_PI / 180;
-        Eigen::AngleAxisd rotation_vector_x(roll_rad, Eigen::Vector3d::UnitX());
-        Eigen::AngleAxisd rotation_vector_y(pitch_rad, Eigen::Vector3d::UnitY());
-        Eigen::AngleAxisd rotation_vector_z(yaw_rad, Eigen::Vector3d::UnitZ());
-        Eigen::Quaterniond q = rotation_vector_x * rotation_vector_y * rotation_vector_z;
-        Eigen::Matrix3d rotation_matrix = q.toRotationMatrix();
-        Eigen::Matrix3d rotation_matrix_inverse = rotation_matrix.inverse();
-        Eigen::Quaterniond q_inverse(rotation_matrix_inverse);
-        static_transform.transform.rotation.x = q.x();
-        static_transform.transform.rotation.y = q.y();
-        static_transform.transform.rotation.z = q.z();
-        static_transform.transform.rotation.w = q.w();
+/**
+ * @brief Publishes the extrinsics of a file once on the latched /tf_static topic. The
+ * transforms are computed when the file is loaded, afterwards the node only wakes up to
+ * reload the file when it changes.
+ *
+ */
+class StaticTfPublisher {
+public:
+    explicit StaticTfPublisher(const std::string& path) : path_(path) {}
 
-        static_transforms.push_back(static_transform);
+    /**
+     * @brief Reads the file and publishes its transforms if they differ from the ones
+     * already sent. A file that does not parse keeps the previous transforms.
+     *
+     * @return false if the file could not be read or parsed
+     */
+    bool load() {
+        std::vector<ExtrinsicTransform> extrinsics;
+        std::string error;
+        if (!your_tf_package::loadExtrinsics(path_, extrinsics, &error)) {
+            ROS_WARN("Could not load the extrinsics from %s: %s", path_.c_str(), error.c_str());
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (extrinsics == extrinsics_) {
+            ROS_DEBUG("Extrinsics in %s did not change", path_.c_str());
+            return true;
+        }
+        std::set<std::string> children;
+        const ros::Time stamp = ros::Time::now();
+        std::vector<geometry_msgs::TransformStamped> static_transforms;
+        for (const auto& extrinsic : extrinsics) {
+            static_transforms.push_back(toTransformStamped(extrinsic, stamp));
+            children.insert(extrinsic.child);
+        }
+        for (const auto& extrinsic : extrinsics_) {
+            if (children.count(extrinsic.child) == 0) {
+                ROS_WARN("Frame %s was removed from %s but stays on /tf_static until the node restarts",
+                         extrinsic.child.c_str(), path_.c_str());
+            }
+        }
+        // The broadcaster replaces transforms with the same child frame and latches the set
+        broadcaster_.sendTransform(static_transforms);
+        ROS_INFO("Published %zu static transforms from %s", static_transforms.size(), path_.c_str());
+        extrinsics_ = std::move(extrinsics);
+        return true;
     }
-    static_broadcaster.sendTransform(static_transforms);
-}
+
+private:
+    std::string path_;
+    // load runs on the main thread and on the file watcher thread
+    std::mutex mutex_;
+    std::vector<ExtrinsicTransform> extrinsics_;
+    tf2_ros::StaticTransformBroadcaster broadcaster_;
+};
 
 int main(int argc, char** argv) {
     ros::init(argc, argv, "tf_publisher_cpp_node");
     ros::NodeHandle nh;
-    ros::Rate rate(10);
-    while (ros::ok()) {
-        publish_static_transforms();
-        rate.sleep();
+    ros::NodeHandle pnh("~");
+    std::string path;
+    bool watch;
+    pnh.param<std::string>("extrinsics_file", path, "");
+    pnh.param("watch", watch, true);
+    if (path.empty()) {
+        ROS_ERROR("~extrinsics_file is not set");
+        return 1;
+    }
+    StaticTfPublisher publisher(path);
+    if (!publisher.load()) {
+        return 1;
+    }
+    std::unique_ptr<your_tf_package::FileWatcher> watcher;
+    if (watch) {
+        try {
+            watcher.reset(new your_tf_package::FileWatcher(path, [&publisher]() { publisher.load(); }));
+        } catch (const std::runtime_error& e) {
+            ROS_WARN("%s, the extrinsics will not be reloaded", e.what());
+        }
     }
+    // Nothing is republished, the latched topic serves late subscribers
+    ros::spin();
     return 0;
 }